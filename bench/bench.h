@@ -0,0 +1,118 @@
+/**
+ * @file bench.h
+ * @brief Helpers shared by the benchmarks.
+ *
+ * Include it after `../express.h`.
+ *
+ * Benchmarks must be linked with `bench/wrap.c` and `BENCH_LDFLAGS` (see the
+ * makefile), which route every `malloc`, `calloc`, `aligned_alloc` and
+ * `free` of the benchmark and Express code through the counters of
+ * bench_allocs.
+ */
+
+#ifndef EXPRESS_BENCH_H
+#define EXPRESS_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @typedef BenchAllocs
+ * @brief Allocator calls made by the code under benchmark.
+ *
+ * Counted per thread, so producers don't share a cache line.
+ */
+typedef struct BenchAllocs {
+  uint64_t allocs; /**< Calls to malloc, calloc and aligned_alloc.*/
+  uint64_t frees;  /**< Calls to free with a non **NULL** pointer.*/
+} BenchAllocs;
+
+/**
+ * @brief Allocator calls of the calling thread, counted by bench/wrap.c.
+ */
+extern _Thread_local BenchAllocs bench_allocs;
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point in the past.
+ */
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Measures the cost of an empty timed region.
+ *
+ * @return Smallest difference between two back to back bench_now_ns calls.
+ */
+static inline uint64_t bench_clock_overhead(void) {
+  uint64_t best = UINT64_MAX;
+  for (int i = 0; i < 1000; i++) {
+    uint64_t start = bench_now_ns();
+    uint64_t elapsed = bench_now_ns() - start;
+    if (elapsed < best)
+      best = elapsed;
+  }
+  return best;
+}
+
+/**
+ * @brief Reads the first line of a file without its newline.
+ *
+ * @param path File to read.
+ * @param buf Buffer to fill, set to "unknown" when the file can't be read.
+ * @param size Size of **buf**.
+ */
+static inline void bench_read_line(const char *path, char *buf, size_t size) {
+  FILE *file = fopen(path, "r");
+  if (!file || !fgets(buf, (int)size, file))
+    snprintf(buf, size, "unknown");
+  if (file)
+    fclose(file);
+  buf[strcspn(buf, "\n")] = '\0';
+}
+
+/**
+ * @brief Writes the machine the benchmark runs on as a JSON object.
+ *
+ * @param out Stream to write to.
+ *
+ * Results are only comparable between runs with the same CPU model and
+ * frequency governor.
+ */
+static inline void bench_host_json(FILE *out) {
+  char cpu[256] = "unknown";
+  char governor[64];
+  char line[512];
+
+  FILE *info = fopen("/proc/cpuinfo", "r");
+  while (info && fgets(line, sizeof(line), info)) {
+    if (strncmp(line, "model name", 10) && strncmp(line, "Model", 5))
+      continue;
+    char *value = strchr(line, ':');
+    if (value) {
+      value += strspn(value + 1, " \t") + 1;
+      snprintf(cpu, sizeof(cpu), "%.*s", (int)strcspn(value, "\n"), value);
+      break;
+    }
+  }
+  if (info)
+    fclose(info);
+
+  bench_read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+                  governor, sizeof(governor));
+
+  fprintf(out, "{\"cpu\": \"");
+  for (const char *c = cpu; *c; c++)
+    fprintf(out, *c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+  fprintf(out, "\", \"governor\": \"%s\", \"cpus\": %ld}", governor,
+          sysconf(_SC_NPROCESSORS_ONLN));
+}
+
+#endif /* EXPRESS_BENCH_H */
@@ -0,0 +1,193 @@
+/**
+ * @file chain.c
+ * @brief End to end latency of express_execute on chains of synthetic
+ * callbacks.
+ *
+ * Usage: `chain [length] [cost] [trigger] [rounds]`
+ *
+ * - `length` callbacks per chain, 1000 by default.
+ * - `cost` of every callback: `empty` (default), `spin:N` to busy wait N
+ *   nanoseconds or `touch:M` to write one byte per cache line of the same M
+ *   bytes buffer.
+ * - `trigger` position of the callback that returns E_TRIGGER, counted from
+ *   1, 0 for none. Without it the first, middle and last positions and no
+ *   trigger at all are measured.
+ * - `rounds` chains executed per case, 1000 by default.
+ *
+ * Each round fills the chain with express_add_many, outside of the timed
+ * region, then times one express_execute. The same callbacks are also called
+ * directly in a loop, which gives the cost of the work alone: the difference
+ * is the dispatch overhead of the chain.
+ *
+ * Results are written to `stdout` as JSON:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "length": 1000, "cost": "empty", "results": [
+ *   {"trigger": 500, "executed": 500, "execute_ns": {...}, "direct_ns":
+ *   {...}, "dispatch_ns_per_callback": 8.1}, ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include "bench.h"
+
+/**
+ * @typedef ChainCost
+ * @brief Work done by every callback.
+ */
+typedef enum ChainCost {
+  C_EMPTY, /**< Returns right away.*/
+  C_SPIN,  /**< Busy waits a number of clock ticks.*/
+  C_TOUCH, /**< Writes one byte per cache line of a buffer.*/
+} ChainCost;
+
+static ChainCost cost = C_EMPTY;
+static uint64_t spin_ticks;
+static volatile unsigned char *touch;
+static size_t touch_bytes;
+static size_t trigger_at;
+static size_t calls;
+
+static ExpressCommand work_callback(void) {
+  switch (cost) {
+  case C_SPIN: {
+    uint64_t start = express_ticks();
+    while (express_ticks() - start < spin_ticks)
+      ;
+    break;
+  }
+  case C_TOUCH:
+    for (size_t i = 0; i < touch_bytes; i += EXPRESS_CACHE_LINE)
+      touch[i]++;
+    break;
+  default:
+    break;
+  }
+
+  return ++calls == trigger_at ? E_TRIGGER : E_CONTINUE;
+}
+
+/**
+ * @brief Converts nanoseconds to clock ticks.
+ *
+ * @param ns Nanoseconds.
+ * @return Ticks, measured against the monotonic clock over 10ms.
+ */
+static uint64_t ticks_for(uint64_t ns) {
+  ExpressClock clock = express_clock_start();
+  while (express_now_ns() - clock.ns < 10000000)
+    ;
+  return (uint64_t)((double)ns / express_clock_scale(&clock));
+}
+
+static void latency_json(const char *name, const Histogram *histogram,
+                         double scale) {
+  ExpressLatency latency = histogram_latency(histogram, scale);
+  printf("\"%s\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, "
+         "\"max\": %llu}",
+         name, (unsigned long long)latency.p50,
+         (unsigned long long)latency.p99, (unsigned long long)latency.p999,
+         (unsigned long long)latency.max);
+}
+
+static void run(size_t length, size_t trigger, size_t rounds,
+                const char *separator) {
+  ExpressCallback *cbs = malloc(length * sizeof(ExpressCallback));
+  Histogram *execute = calloc(1, sizeof(Histogram));
+  Histogram *direct = calloc(1, sizeof(Histogram));
+  if (!cbs || !execute || !direct) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < length; i++)
+    cbs[i] = work_callback;
+
+  Express app = express_create();
+  ExpressClock clock = express_clock_start();
+  uint64_t execute_sum = 0, direct_sum = 0;
+  size_t executed = 0;
+  trigger_at = trigger;
+
+  for (size_t r = 0; r < rounds; r++) {
+    express_add_many(&app, cbs, length);
+    calls = 0;
+    uint64_t start = express_ticks();
+    express_execute(&app);
+    uint64_t ticks = express_ticks() - start;
+    histogram_record(execute, ticks);
+    execute_sum += ticks;
+    executed = calls;
+    list_clear(&app.chain);
+
+    calls = 0;
+    start = express_ticks();
+    for (size_t i = 0; i < length && cbs[i]() == E_CONTINUE; i++)
+      ;
+    ticks = express_ticks() - start;
+    histogram_record(direct, ticks);
+    direct_sum += ticks;
+  }
+
+  double scale = express_clock_scale(&clock);
+  printf("%s  {\"trigger\": %zu, \"executed\": %zu, ", separator, trigger,
+         executed);
+  latency_json("execute_ns", execute, scale);
+  printf(", ");
+  latency_json("direct_ns", direct, scale);
+  printf(", \"dispatch_ns_per_callback\": %.2f}",
+         ((double)execute_sum - (double)direct_sum) * scale /
+             ((double)rounds * (double)executed));
+  fflush(stdout);
+
+  express_destroy(&app);
+  free(cbs);
+  free(execute);
+  free(direct);
+}
+
+int main(int argc, char **argv) {
+  size_t length = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+  const char *spec = argc > 2 ? argv[2] : "empty";
+  size_t rounds = argc > 4 ? strtoul(argv[4], NULL, 10) : 1000;
+
+  if (!strncmp(spec, "spin:", 5)) {
+    cost = C_SPIN;
+    spin_ticks = ticks_for(strtoull(spec + 5, NULL, 10));
+  } else if (!strncmp(spec, "touch:", 6)) {
+    cost = C_TOUCH;
+    touch_bytes = strtoul(spec + 6, NULL, 10);
+    touch = calloc(touch_bytes ? touch_bytes : 1, 1);
+    if (!touch) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+  } else if (strcmp(spec, "empty")) {
+    length = 0;
+  }
+
+  if (!length || !rounds || (argc > 3 && strtoul(argv[3], NULL, 10) > length)) {
+    fprintf(stderr,
+            "usage: %s [length] [empty|spin:N|touch:M] [trigger] [rounds]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"length\": %zu, \"cost\": \"%s\",\n \"results\": [", length,
+         spec);
+
+  if (argc > 3) {
+    run(length, strtoul(argv[3], NULL, 10), rounds, "\n");
+  } else {
+    run(length, 0, rounds, "\n");
+    run(length, 1, rounds, ",\n");
+    run(length, (length + 1) / 2, rounds, ",\n");
+    run(length, length, rounds, ",\n");
+  }
+  printf("\n]}\n");
+
+  free((void *)touch);
+  return 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Compares bench/micro results against a baseline.
+
+Usage:
+    compare.py BASELINE RESULTS...           fail on regressions
+    compare.py --update BASELINE RESULTS...  replace the baseline results
+
+With several RESULTS files, from repeated runs, every metric keeps its best
+(lowest) value, which filters out most of the noise of a shared machine.
+
+The baseline holds the results of a reference run together with the
+tolerance of every compared metric, as a fraction of the baseline value:
+
+    {"tolerances": {"ns_per_op": 0.25, "allocs_per_op": 0},
+     "overrides": {"node_create": {"ns_per_op": 0.5}},
+     "host": {...}, "results": [...]}
+
+All the compared metrics are lower is better. A result regresses when it is
+above baseline * (1 + tolerance). Results are matched on name and length,
+the ones missing on either side are listed but do not fail. Only the
+metrics outside of their tolerance are printed.
+"""
+
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return json.load(f)
+
+
+def key(result):
+    return result["name"], result["length"]
+
+
+def best(runs):
+    merged = {}
+    for run in runs:
+        for result in run["results"]:
+            k = key(result)
+            if k not in merged:
+                merged[k] = dict(result)
+                continue
+            for metric, value in result.items():
+                if isinstance(value, float) and value < merged[k][metric]:
+                    merged[k][metric] = value
+    return {"host": runs[0]["host"], "results": list(merged.values())}
+
+
+def host_line(host):
+    return "%s, governor %s, %s cpus" % (host.get("cpu"), host.get("governor"),
+                                         host.get("cpus"))
+
+
+def compare(baseline, current):
+    tolerances = baseline.get("tolerances", {})
+    overrides = baseline.get("overrides", {})
+    base = {key(r): r for r in baseline["results"]}
+    cur = {key(r): r for r in current["results"]}
+
+    if baseline.get("host") != current.get("host"):
+        print("warning: host differs from the baseline")
+        print("  baseline: " + host_line(baseline.get("host", {})))
+        print("  current:  " + host_line(current.get("host", {})))
+        print()
+
+    rows = []
+    regressions = 0
+    for k in sorted(base.keys() & cur.keys()):
+        for metric, tolerance in sorted(tolerances.items()):
+            tolerance = overrides.get(k[0], {}).get(metric, tolerance)
+            old, new = base[k][metric], cur[k][metric]
+            limit = old * (1 + tolerance)
+            change = (new - old) / old * 100 if old else 0.0
+            status = "ok"
+            if new > limit and new - old > 1e-9:
+                status = "REGRESSION"
+                regressions += 1
+            elif new < old / (1 + tolerance):
+                status = "improved"
+            rows.append((k[0], k[1], metric, old, new, change, status))
+
+    changed = [row for row in rows if row[-1] != "ok"]
+    if changed:
+        print("%-16s %9s %-14s %12s %12s %8s  %s" %
+              ("name", "length", "metric", "baseline", "current", "change",
+               "status"))
+    for name, length, metric, old, new, change, status in changed:
+        print("%-16s %9d %-14s %12.3f %12.3f %+7.1f%%  %s" %
+              (name, length, metric, old, new, change, status))
+
+    for k in sorted(base.keys() - cur.keys()):
+        print("missing from the results: %s %d" % k)
+    for k in sorted(cur.keys() - base.keys()):
+        print("not in the baseline: %s %d" % k)
+
+    print("%d metrics compared, %d regression(s)" % (len(rows), regressions))
+    return regressions
+
+
+def main(argv):
+    update = "--update" in argv
+    paths = [a for a in argv[1:] if a != "--update"]
+    if len(paths) < 2:
+        sys.stderr.write(__doc__)
+        return 2
+
+    baseline = load(paths[0])
+    current = best([load(path) for path in paths[1:]])
+    if update:
+        baseline["host"] = current["host"]
+        baseline["results"] = current["results"]
+        with open(paths[0], "w") as f:
+            json.dump(baseline, f, indent=1)
+            f.write("\n")
+        return 0
+
+    return 1 if compare(baseline, current) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,207 @@
+/**
+ * @file dispatch.c
+ * @brief Cost of the dispatch engines on predictable and unpredictable
+ * chains.
+ *
+ * Usage: `dispatch [length] [rounds]`
+ *
+ * Built once per engine by `make bench-dispatch`, see EXPRESS_DISPATCH. Each
+ * binary runs chains of 16 different callbacks, that only add a constant to
+ * a global, in four orders:
+ *
+ * - `uniform` the same callback over and over.
+ * - `cyclic` the 16 callbacks in turn, a pattern a predictor can learn.
+ * - `random` a random callback each time, which defeats the predictor of the
+ *   indirect call of the list and array engines.
+ * - `unregistered` random callbacks that are not in EXPRESS_CALLBACKS, the
+ *   fallback path of the switch and goto engines.
+ *
+ * Each order is run on chains filled with express_add_many, one node per
+ * callback, and with express_build_from_array, one NodeBlock, which the
+ * array engine runs by index. Only express_execute is timed, the chain is
+ * filled before each round.
+ * Results are written to `stdout` as JSON. Before timing anything, the
+ * binary checks that chains with **NULL** entries run the right callbacks
+ * with its engine, and fails otherwise.
+ */
+
+#define DISPATCH_WORK(X)                                                       \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13)    \
+      X(14) X(15)
+#define EXPRESS_CALLBACKS(X)                                                   \
+  X(work_0) X(work_1) X(work_2) X(work_3) X(work_4) X(work_5) X(work_6)        \
+      X(work_7) X(work_8) X(work_9) X(work_10) X(work_11) X(work_12)           \
+          X(work_13) X(work_14) X(work_15)
+
+#include "../express.h"
+
+#include "bench.h"
+
+#define DISPATCH_CALLBACKS 16
+
+static const char *engine_names[] = {"list", "array", "switch", "goto"};
+
+uint64_t dispatch_sink;
+
+#define DISPATCH_DEFINE(n)                                                     \
+  ExpressCommand work_##n(void) {                                              \
+    dispatch_sink += n + 1;                                                    \
+    return E_CONTINUE;                                                         \
+  }                                                                            \
+  static ExpressCommand other_##n(void) {                                      \
+    dispatch_sink += n + 2;                                                    \
+    return E_CONTINUE;                                                         \
+  }
+DISPATCH_WORK(DISPATCH_DEFINE)
+
+#define DISPATCH_WORK_ENTRY(n) work_##n,
+#define DISPATCH_OTHER_ENTRY(n) other_##n,
+static const ExpressCallback registered[] = {DISPATCH_WORK(DISPATCH_WORK_ENTRY)};
+static const ExpressCallback unregistered[] = {
+    DISPATCH_WORK(DISPATCH_OTHER_ENTRY)};
+
+/**
+ * @typedef DispatchOrder
+ * @brief Order of the callbacks of a chain.
+ */
+typedef enum DispatchOrder {
+  D_UNIFORM,
+  D_CYCLIC,
+  D_RANDOM,
+  D_UNREGISTERED,
+  D_ORDERS,
+} DispatchOrder;
+
+static const char *order_names[D_ORDERS] = {"uniform", "cyclic", "random",
+                                            "unregistered"};
+
+static uint64_t xorshift(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void fill(ExpressCallback *cbs, size_t length, DispatchOrder order) {
+  uint64_t state = 0x9e3779b97f4a7c15u;
+
+  for (size_t i = 0; i < length; i++) {
+    switch (order) {
+    case D_UNIFORM:
+      cbs[i] = registered[0];
+      break;
+    case D_CYCLIC:
+      cbs[i] = registered[i % DISPATCH_CALLBACKS];
+      break;
+    case D_RANDOM:
+      cbs[i] = registered[xorshift(&state) % DISPATCH_CALLBACKS];
+      break;
+    default:
+      cbs[i] = unregistered[xorshift(&state) % DISPATCH_CALLBACKS];
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Checks that every builder skips **NULL** entries, at the head of an
+ * empty chain and after queued nodes, without breaking the tags of the
+ * switch and goto engines.
+ *
+ * @return Zero when the chain ran exactly the non **NULL** callbacks.
+ */
+static int check_null_entries(void) {
+  ExpressCallback head[] = {NULL, work_1, NULL, work_2};
+  ExpressCallback tail[] = {work_3, NULL, other_4, NULL};
+  Express app = express_create();
+
+  express_add_many(&app, head, 4);
+  express_add(&app, work_5);
+  express_add_many(&app, tail, 4);
+  express_build_from_array(&app, head, 4);
+  express_build_from_array(&app, tail, 4);
+  express_add(&app, NULL);
+
+  uint64_t before = dispatch_sink;
+  express_execute(&app);
+  uint64_t ran = dispatch_sink - before;
+  express_destroy(&app);
+
+  /* work_n adds n + 1, other_n adds n + 2. */
+  uint64_t expected = 2 + 3 + 6 + 4 + 6 + 2 + 3 + 4 + 6;
+  if (ran != expected) {
+    fprintf(stderr, "%s engine: NULL entries ran %llu, expected %llu\n",
+            engine_names[EXPRESS_DISPATCH], (unsigned long long)ran,
+            (unsigned long long)expected);
+    return 1;
+  }
+  return 0;
+}
+
+static void run(ExpressCallback *cbs, size_t length, size_t rounds,
+                DispatchOrder order, int block, const char *separator) {
+  Histogram *latency = calloc(1, sizeof(Histogram));
+  if (!latency) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  fill(cbs, length, order);
+  Express app = express_create();
+  ExpressClock clock = express_clock_start();
+  uint64_t total = 0;
+
+  for (size_t r = 0; r < rounds; r++) {
+    if (block)
+      express_build_from_array(&app, cbs, length);
+    else
+      express_add_many(&app, cbs, length);
+    uint64_t start = express_ticks();
+    express_execute(&app);
+    uint64_t ticks = express_ticks() - start;
+    histogram_record(latency, ticks);
+    total += ticks;
+  }
+
+  double scale = express_clock_scale(&clock);
+  ExpressLatency execute = histogram_latency(latency, scale);
+  printf("%s  {\"order\": \"%s\", \"builder\": \"%s\", "
+         "\"ns_per_callback\": %.2f, "
+         "\"execute_ns\": {\"p50\": %llu, \"p99\": %llu, \"max\": %llu}}",
+         separator, order_names[order],
+         block ? "build_from_array" : "add_many",
+         (double)total * scale / ((double)rounds * (double)length),
+         (unsigned long long)execute.p50, (unsigned long long)execute.p99,
+         (unsigned long long)execute.max);
+  fflush(stdout);
+
+  express_destroy(&app);
+  free(latency);
+}
+
+int main(int argc, char **argv) {
+  size_t length = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+  size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 2000;
+
+  ExpressCallback *cbs = malloc(length * sizeof(ExpressCallback));
+  if (!length || !rounds || !cbs) {
+    fprintf(stderr, "usage: %s [length] [rounds]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  if (check_null_entries())
+    return EXIT_FAILURE;
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"engine\": \"%s\", \"length\": %zu,\n \"results\": [",
+         engine_names[EXPRESS_DISPATCH], length);
+  for (int block = 0; block < 2; block++)
+    for (DispatchOrder order = 0; order < D_ORDERS; order++)
+      run(cbs, length, rounds, order, block,
+          block || order ? ",\n" : "\n");
+  printf("\n]}\n");
+
+  free(cbs);
+  return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file enqueue.c
+ * @brief Enqueue cost of the Express variants under concurrent producers.
+ *
+ * Compares the plain mutex path with the sharded, per-CPU and flat combining
+ * variants.
+ *
+ * Usage: `enqueue [threads] [adds per thread]`
+ *
+ * Every thread adds the same no-op callback in a loop. The measured time ends
+ * once every callback is in the chain, so it includes the final
+ * express_percpu_flush of the partly filled per-CPU buffers. The chain is
+ * drained after each run and is not part of the measured time.
+ *
+ * Results are written to `stdout` as JSON, one entry per variant and
+ * producer count. `length` is the number of producers, so bench/compare.py
+ * matches the entries like those of bench/micro. `ns_per_op` is the wall
+ * time one producer spends per add, `ops_per_sec` the throughput of all the
+ * producers together and `allocs_per_op` the allocator calls per add:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "adds": 1000000, "results": [{"name": "mutex",
+ *   "length": 1, "ns_per_op": 88.9, "ops_per_sec": 11251571,
+ *   "allocs_per_op": 1.000, "frees_per_op": 0.000}, ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include "bench.h"
+
+/**
+ * @typedef EnqueueMode
+ * @brief Express variant under benchmark.
+ */
+typedef enum EnqueueMode {
+  M_MUTEX,     /**< Plain Express, one mutex.*/
+  M_SHARDED,   /**< ExpressSharded, one shard per thread.*/
+  M_PERCPU,    /**< ExpressPerCpu, staging buffer per CPU.*/
+  M_COMBINING, /**< ExpressCombining, flat combining.*/
+  M_COUNT,
+} EnqueueMode;
+
+static const char *mode_names[M_COUNT] = {"mutex", "sharded", "percpu",
+                                         "combining"};
+
+/**
+ * @typedef Bench
+ * @brief Shared state of one benchmark run.
+ */
+typedef struct Bench {
+  EnqueueMode mode;
+  size_t adds;
+  Express mutex;
+  ExpressSharded sharded;
+  ExpressPerCpu percpu;
+  ExpressCombining combining;
+  pthread_barrier_t start;
+  atomic_uint_fast64_t allocs; /**< Allocator calls of all the threads.*/
+  atomic_uint_fast64_t frees;  /**< Calls to free of all the threads.*/
+} Bench;
+
+static ExpressCommand noop_callback(void) { return E_CONTINUE; }
+
+static void *producer(void *arg) {
+  Bench *bench = arg;
+
+  pthread_barrier_wait(&bench->start);
+  BenchAllocs before = bench_allocs;
+  switch (bench->mode) {
+  case M_MUTEX:
+    for (size_t i = 0; i < bench->adds; i++)
+      express_add(&bench->mutex, noop_callback);
+    break;
+  case M_SHARDED:
+    for (size_t i = 0; i < bench->adds; i++)
+      express_sharded_add(&bench->sharded, noop_callback);
+    break;
+  case M_PERCPU:
+    for (size_t i = 0; i < bench->adds; i++)
+      express_percpu_add(&bench->percpu, noop_callback);
+    break;
+  case M_COMBINING:
+    for (size_t i = 0; i < bench->adds; i++)
+      express_combining_add(&bench->combining, noop_callback);
+    break;
+  default:
+    break;
+  }
+  atomic_fetch_add(&bench->allocs, bench_allocs.allocs - before.allocs);
+  atomic_fetch_add(&bench->frees, bench_allocs.frees - before.frees);
+
+  return NULL;
+}
+
+static uint64_t run(Bench *bench, size_t threads) {
+  pthread_t *ids = malloc(threads * sizeof(pthread_t));
+  if (!ids) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  pthread_barrier_init(&bench->start, NULL, threads + 1);
+  for (size_t i = 0; i < threads; i++)
+    pthread_create(&ids[i], NULL, producer, bench);
+
+  pthread_barrier_wait(&bench->start);
+  uint64_t begin = bench_now_ns();
+  BenchAllocs before = bench_allocs;
+  for (size_t i = 0; i < threads; i++)
+    pthread_join(ids[i], NULL);
+  /* Staged callbacks are not in the chain yet, moving them is part of the
+   * cost of an add. */
+  if (bench->mode == M_PERCPU)
+    express_percpu_flush(&bench->percpu);
+  uint64_t elapsed = bench_now_ns() - begin;
+  atomic_fetch_add(&bench->allocs, bench_allocs.allocs - before.allocs);
+  atomic_fetch_add(&bench->frees, bench_allocs.frees - before.frees);
+
+  pthread_barrier_destroy(&bench->start);
+  free(ids);
+
+  express_execute(&bench->mutex);
+  express_sharded_execute(&bench->sharded);
+  express_percpu_execute(&bench->percpu);
+  express_combining_execute(&bench->combining);
+
+  return elapsed;
+}
+
+static void report(size_t adds, size_t threads, const char **separator) {
+  for (EnqueueMode mode = 0; mode < M_COUNT; mode++) {
+    Bench bench = {.mode = mode, .adds = adds};
+    atomic_init(&bench.allocs, 0);
+    atomic_init(&bench.frees, 0);
+    bench.mutex = express_create();
+    bench.sharded = express_sharded_create(threads);
+    bench.percpu = express_percpu_create();
+    bench.combining = express_combining_create();
+
+    uint64_t elapsed = run(&bench, threads);
+    double ops = (double)(adds * threads);
+    double ns = elapsed ? (double)elapsed : 1;
+    printf("%s  {\"name\": \"%s\", \"length\": %zu, \"ns_per_op\": %.2f, "
+           "\"ops_per_sec\": %.0f, \"allocs_per_op\": %.3f, "
+           "\"frees_per_op\": %.3f}",
+           *separator, mode_names[mode], threads, ns / (double)adds,
+           ops * 1e9 / ns, (double)atomic_load(&bench.allocs) / ops,
+           (double)atomic_load(&bench.frees) / ops);
+    *separator = ",\n";
+    fflush(stdout);
+
+    express_destroy(&bench.mutex);
+    express_sharded_destroy(&bench.sharded);
+    express_percpu_destroy(&bench.percpu);
+    express_combining_destroy(&bench.combining);
+  }
+}
+
+int main(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_threads = argc > 1 ? strtoul(argv[1], NULL, 10)
+                                : (cpus > 0 ? (size_t)cpus : 1);
+  size_t adds = argc > 2 ? strtoul(argv[2], NULL, 10) : 1000000;
+
+  if (!max_threads || !adds) {
+    fprintf(stderr, "usage: %s [threads] [adds per thread]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"adds\": %zu,\n \"results\": [", adds);
+
+  const char *separator = "\n";
+  size_t threads = 1;
+  for (; threads < max_threads; threads *= 2)
+    report(adds, threads, &separator);
+  report(adds, max_threads, &separator);
+  printf("\n]}\n");
+
+  return 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file memory.c
+ * @brief Memory footprint of queued callbacks and how fast it is given back.
+ *
+ * Usage: `memory [max entries]`
+ *
+ * For 10^6, 10^7 ... up to the max entries (10^7 by default, 10^8 needs
+ * about 5 GB), a fresh Express object is filled with express_add, then
+ * drained with express_execute and destroyed. The resident set size (from
+ * `/proc/self/statm`) and the heap of the allocator (from `mallinfo2`) are
+ * read after every step. At the end `malloc_trim` hands any free memory
+ * left to the OS, which shows what the allocator kept on its own.
+ *
+ * Results are written to `stdout` as JSON, sizes in bytes:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "node_bytes": 24, "results": [{"entries": 1000000,
+ *   "rss_per_entry": 32.1, "heap_per_entry": 32.0, "overhead_per_entry":
+ *   8.0, "rss": {"filled": ..., "executed": ..., "destroyed": ...,
+ *   "trimmed": ...}, "ms": {"fill": ..., "execute": ..., "trim": ...}},
+ *   ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * `rss` values are above the resident size before the Express object was
+ * created.
+ *
+ * Built with EXPRESS_MEM_STATS, the benchmark first checks that the
+ * accounting of an Express object agrees with the process totals while a
+ * chain built with express_build_from_array is partly drained, and fails
+ * otherwise.
+ */
+
+#include "../express.h"
+
+#include <malloc.h>
+
+#include "bench.h"
+
+static ExpressCommand noop_callback(void) { return E_CONTINUE; }
+
+#ifdef EXPRESS_MEM_STATS
+static ExpressCommand stop_callback(void) { return E_TRIGGER; }
+
+/**
+ * @brief Compares the live nodes and bytes of an Express object, the only
+ * one alive, with the process totals.
+ *
+ * @param app Pointer to Express object.
+ * @param nodes Nodes that should be live.
+ * @param step Label of the check.
+ * @return Zero when all of them agree.
+ */
+static int check_live(Express *app, uint64_t nodes, const char *step) {
+  ExpressMemStats local = express_mem_stats(app);
+  ExpressMemStats global = express_mem_stats_global();
+  if (local.live_nodes == nodes && global.live_nodes == nodes &&
+      local.live_bytes == global.live_bytes)
+    return 0;
+
+  fprintf(stderr,
+          "%s: live nodes %llu, process %llu, expected %llu, live bytes "
+          "%llu, process %llu\n",
+          step, (unsigned long long)local.live_nodes,
+          (unsigned long long)global.live_nodes, (unsigned long long)nodes,
+          (unsigned long long)local.live_bytes,
+          (unsigned long long)global.live_bytes);
+  return 1;
+}
+
+/**
+ * @brief Partly drains chains mixing single nodes and NodeBlocks.
+ *
+ * @return Zero when the accounting stayed consistent.
+ */
+static int check_accounting(void) {
+  ExpressCallback first[] = {noop_callback, noop_callback, stop_callback,
+                             noop_callback, noop_callback};
+  ExpressCallback second[] = {noop_callback, stop_callback, noop_callback,
+                              noop_callback};
+  Express app = express_create();
+  int failed = 0;
+
+  express_build_from_array(&app, first, 5);
+  express_add(&app, noop_callback);
+  express_build_from_array(&app, second, 4);
+  failed |= check_live(&app, 10, "built");
+
+  /* The first block keeps its 5 nodes until its last one ran. */
+  express_execute(&app);
+  failed |= check_live(&app, 10, "first block partly drained");
+  express_execute(&app);
+  failed |= check_live(&app, 4, "second block partly drained");
+  express_execute(&app);
+  failed |= check_live(&app, 0, "drained");
+
+  express_build_from_array(&app, first, 5);
+  express_execute(&app);
+  express_destroy(&app);
+  ExpressMemStats global = express_mem_stats_global();
+  if (global.live_nodes || global.live_bytes) {
+    fprintf(stderr, "destroyed: process live nodes %llu, live bytes %llu\n",
+            (unsigned long long)global.live_nodes,
+            (unsigned long long)global.live_bytes);
+    failed = 1;
+  }
+  return failed;
+}
+#endif
+
+/**
+ * @brief Reads the resident set size of the process.
+ *
+ * @return Resident bytes.
+ */
+static uint64_t rss_bytes(void) {
+  unsigned long size = 0, resident = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm) {
+    if (fscanf(statm, "%lu %lu", &size, &resident) != 2)
+      resident = 0;
+    fclose(statm);
+  }
+  return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief Reads the bytes the allocator handed out.
+ *
+ * @return Bytes in use, including chunk headers.
+ */
+static uint64_t heap_bytes(void) {
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+static double ms_since(uint64_t start) {
+  return (double)(bench_now_ns() - start) / 1e6;
+}
+
+static void run(size_t entries, const char *separator) {
+  malloc_trim(0);
+  uint64_t rss = rss_bytes();
+  uint64_t heap = heap_bytes();
+
+  Express app = express_create();
+  uint64_t start = bench_now_ns();
+  for (size_t i = 0; i < entries; i++)
+    express_add(&app, noop_callback);
+  double fill_ms = ms_since(start);
+  uint64_t filled = rss_bytes() - rss;
+  uint64_t used = heap_bytes() - heap;
+
+  start = bench_now_ns();
+  express_execute(&app);
+  double execute_ms = ms_since(start);
+  int64_t executed = (int64_t)(rss_bytes() - rss);
+
+  express_destroy(&app);
+  int64_t destroyed = (int64_t)(rss_bytes() - rss);
+
+  start = bench_now_ns();
+  malloc_trim(0);
+  double trim_ms = ms_since(start);
+  int64_t trimmed = (int64_t)(rss_bytes() - rss);
+
+  printf("%s  {\"entries\": %zu, \"rss_per_entry\": %.2f, "
+         "\"heap_per_entry\": %.2f, \"overhead_per_entry\": %.2f, "
+         "\"rss\": {\"filled\": %llu, \"executed\": %lld, \"destroyed\": "
+         "%lld, \"trimmed\": %lld}, \"ms\": {\"fill\": %.1f, \"execute\": "
+         "%.1f, \"trim\": %.1f}}",
+         separator, entries, (double)filled / entries, (double)used / entries,
+         (double)used / entries - sizeof(Node), (unsigned long long)filled,
+         (long long)executed, (long long)destroyed, (long long)trimmed,
+         fill_ms, execute_ms, trim_ms);
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  size_t max_entries = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+  if (max_entries < 1000000) {
+    fprintf(stderr, "usage: %s [max entries >= 1000000]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+#ifdef EXPRESS_MEM_STATS
+  if (check_accounting())
+    return EXIT_FAILURE;
+#endif
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"node_bytes\": %zu,\n \"results\": [", sizeof(Node));
+
+  const char *separator = "\n";
+  for (size_t entries = 1000000; entries <= max_entries; entries *= 10) {
+    run(entries, separator);
+    separator = ",\n";
+  }
+  printf("\n]}\n");
+
+  return 0;
+}
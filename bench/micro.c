@@ -0,0 +1,230 @@
+/**
+ * @file micro.c
+ * @brief Cost of the list primitives and of express_add / express_execute.
+ *
+ * Usage: `micro [max length]`
+ *
+ * Every primitive is measured on chains of 1, 10, 100, ... up to the max
+ * length (10^7 by default). Short chains are repeated until about
+ * MICRO_MIN_OPS operations were timed, in batches of rounds timed together
+ * so that at least MICRO_BATCH_OPS operations run between two clock reads.
+ * Setup and cleanup of each batch are left out of the timed region, and so
+ * is the cost of reading the clock.
+ *
+ * Results are written to `stdout` as JSON:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "results": [{"name": "list_push", "length": 1000,
+ *   "ops": 1000000, "ns_per_op": 12.3, "ops_per_sec": 81300813,
+ *   "allocs_per_op": 1, "frees_per_op": 0}, ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include "bench.h"
+
+/**
+ * @def MICRO_MIN_OPS
+ * @brief Operations timed at least for each primitive and length.
+ */
+#define MICRO_MIN_OPS 1000000
+
+/**
+ * @typedef MicroSample
+ * @brief What the timed regions of one primitive and length added up to.
+ */
+typedef struct MicroSample {
+  uint64_t ns;     /**< Time spent in the timed regions.*/
+  uint64_t allocs; /**< Allocations made in the timed regions.*/
+  uint64_t frees;  /**< Frees made in the timed regions.*/
+  uint64_t start;  /**< Clock at the start of the current region.*/
+  BenchAllocs at;  /**< Counters at the start of the current region.*/
+} MicroSample;
+
+/**
+ * @def MICRO_BATCH_OPS
+ * @brief Operations timed at least between two reads of the clock.
+ *
+ * Rounds over short chains are set up together and timed as one region, so
+ * the cost and the jitter of `clock_gettime` don't swamp a single op.
+ */
+#define MICRO_BATCH_OPS 1024
+
+/**
+ * @typedef MicroBench
+ * @brief **rounds** rounds of a primitive over chains of **n** entries,
+ * timed as one region.
+ */
+typedef void (*MicroBench)(MicroSample *sample, size_t n, size_t rounds);
+
+static uint64_t clock_overhead;
+
+static ExpressCommand noop_callback(void) { return E_CONTINUE; }
+
+static inline void sample_begin(MicroSample *sample) {
+  sample->at = bench_allocs;
+  sample->start = bench_now_ns();
+}
+
+static inline void sample_end(MicroSample *sample) {
+  uint64_t elapsed = bench_now_ns() - sample->start;
+  sample->ns += elapsed > clock_overhead ? elapsed - clock_overhead : 0;
+  sample->allocs += bench_allocs.allocs - sample->at.allocs;
+  sample->frees += bench_allocs.frees - sample->at.frees;
+}
+
+static void *micro_alloc(size_t count, size_t size) {
+  void *ptr = calloc(count, size);
+  if (!ptr) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static void fill(List *list, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    list_push(list, noop_callback);
+}
+
+static void micro_node_create(MicroSample *sample, size_t n, size_t rounds) {
+  size_t count = n * rounds;
+  Node **nodes = micro_alloc(count, sizeof(Node *));
+
+  sample_begin(sample);
+  for (size_t i = 0; i < count; i++)
+    nodes[i] = node_create(noop_callback, NULL, NULL);
+  sample_end(sample);
+
+  for (size_t i = 0; i < count; i++)
+    free(nodes[i]);
+  free(nodes);
+}
+
+static void micro_list_push(MicroSample *sample, size_t n, size_t rounds) {
+  List *lists = micro_alloc(rounds, sizeof(List));
+
+  sample_begin(sample);
+  for (size_t r = 0; r < rounds; r++)
+    fill(&lists[r], n);
+  sample_end(sample);
+
+  for (size_t r = 0; r < rounds; r++)
+    list_clear(&lists[r]);
+  free(lists);
+}
+
+static void micro_list_shift(MicroSample *sample, size_t n, size_t rounds) {
+  List *lists = micro_alloc(rounds, sizeof(List));
+  for (size_t r = 0; r < rounds; r++)
+    fill(&lists[r], n);
+
+  sample_begin(sample);
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t i = 0; i < n; i++)
+      list_shift(&lists[r]);
+  sample_end(sample);
+
+  free(lists);
+}
+
+static void micro_list_clear(MicroSample *sample, size_t n, size_t rounds) {
+  List *lists = micro_alloc(rounds, sizeof(List));
+  for (size_t r = 0; r < rounds; r++)
+    fill(&lists[r], n);
+
+  sample_begin(sample);
+  for (size_t r = 0; r < rounds; r++)
+    list_clear(&lists[r]);
+  sample_end(sample);
+
+  free(lists);
+}
+
+static void micro_express_add(MicroSample *sample, size_t n, size_t rounds) {
+  Express *apps = micro_alloc(rounds, sizeof(Express));
+  for (size_t r = 0; r < rounds; r++)
+    apps[r] = express_create();
+
+  sample_begin(sample);
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t i = 0; i < n; i++)
+      express_add(&apps[r], noop_callback);
+  sample_end(sample);
+
+  for (size_t r = 0; r < rounds; r++)
+    express_destroy(&apps[r]);
+  free(apps);
+}
+
+static void micro_express_execute(MicroSample *sample, size_t n,
+                                  size_t rounds) {
+  Express *apps = micro_alloc(rounds, sizeof(Express));
+  for (size_t r = 0; r < rounds; r++) {
+    apps[r] = express_create();
+    for (size_t i = 0; i < n; i++)
+      express_add(&apps[r], noop_callback);
+  }
+
+  sample_begin(sample);
+  for (size_t r = 0; r < rounds; r++)
+    express_execute(&apps[r]);
+  sample_end(sample);
+
+  for (size_t r = 0; r < rounds; r++)
+    express_destroy(&apps[r]);
+  free(apps);
+}
+
+static const struct {
+  const char *name;
+  MicroBench run;
+} benches[] = {
+    {"node_create", micro_node_create},
+    {"list_push", micro_list_push},
+    {"list_shift", micro_list_shift},
+    {"list_clear", micro_list_clear},
+    {"express_add", micro_express_add},
+    {"express_execute", micro_express_execute},
+};
+
+int main(int argc, char **argv) {
+  size_t max_length = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+  if (!max_length) {
+    fprintf(stderr, "usage: %s [max length]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  clock_overhead = bench_clock_overhead();
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"results\": [");
+
+  const char *separator = "\n";
+  for (size_t b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+    for (size_t n = 1; n <= max_length; n *= 10) {
+      size_t rounds = n < MICRO_MIN_OPS ? MICRO_MIN_OPS / n : 1;
+      size_t batch = (MICRO_BATCH_OPS + n - 1) / n;
+      MicroSample sample = {0};
+
+      for (size_t r = 0; r < rounds; r += batch)
+        benches[b].run(&sample, n, rounds - r < batch ? rounds - r : batch);
+
+      double ops = (double)n * (double)rounds;
+      double ns = sample.ns ? (double)sample.ns : 1;
+      printf("%s  {\"name\": \"%s\", \"length\": %zu, \"ops\": %.0f, "
+             "\"ns_per_op\": %.2f, \"ops_per_sec\": %.0f, "
+             "\"allocs_per_op\": %.3f, \"frees_per_op\": %.3f}",
+             separator, benches[b].name, n, ops, ns / ops, ops * 1e9 / ns,
+             (double)sample.allocs / ops, (double)sample.frees / ops);
+      separator = ",\n";
+      fflush(stdout);
+    }
+  }
+  printf("\n]}\n");
+
+  return 0;
+}
@@ -0,0 +1,286 @@
+/**
+ * @file replay.c
+ * @brief Plays a workload recorded with EXPRESS_RECORD back against this
+ * build.
+ *
+ * Usage: `replay file [speed] [cost ns]`
+ *
+ * Every recorded thread gets a replay thread and every recorded Express
+ * object a fresh one. Each thread repeats its adds and executes at the same
+ * offsets from the start as in the recording, divided by **speed** (1 by
+ * default, 0 replays as fast as possible). The recorded callbacks are
+ * replaced by REPLAY_CALLBACKS synthetic ones, callback number `k` by
+ * synthetic `k % REPLAY_CALLBACKS`, which spin for **cost ns**. The default
+ * cost is the mean time a callback took in the recorded executes. Synthetic
+ * callbacks never trigger, so a replayed execute always drains its chain.
+ *
+ * Build the library with the options to compare (`make -B bench-replay
+ * CFLAGS=... RECORD=file`), the recording is read the same way by any of
+ * them. The library must not be built with EXPRESS_SINGLE_THREADED when the
+ * recording has more than one thread.
+ *
+ * Results are written to `stdout` as JSON, the latencies of the add and
+ * execute calls and how late the calls were issued compared to the
+ * schedule:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "events": 120000, "threads": 4, "apps": 1,
+ *  "callbacks": 3, "speed": 1, "cost_ns": 250, "recorded_ms": 1000.0,
+ *  "replayed_ms": 1000.4, "add_ns": {"p50": ..., "p99": ..., "p999": ...,
+ *  "max": ...}, "execute_ns": {...}, "lag_ns": {...}}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include <pthread.h>
+
+#include "../express_record.h"
+#include "bench.h"
+
+/**
+ * @def REPLAY_CALLBACKS
+ * @brief Number of distinct synthetic callbacks.
+ */
+#define REPLAY_CALLBACKS 16
+
+#define REPLAY_SYNTHETIC(X)                                                    \
+  X(0) X(1) X(2) X(3) X(4) X(5) X(6) X(7) X(8) X(9) X(10) X(11) X(12) X(13)    \
+      X(14) X(15)
+
+/**
+ * @typedef ReplayThread
+ * @brief Events of one recorded thread and what replaying them measured.
+ */
+typedef struct ReplayThread {
+  uint32_t tid;               /**< Recorded thread.*/
+  ExpressRecordEvent *events; /**< Its events, in order.*/
+  size_t count;               /**< Number of events.*/
+  size_t capacity;            /**< Room in events.*/
+  pthread_t thread;           /**< Replay thread.*/
+  Histogram add;              /**< Latency of the adds, in ns.*/
+  Histogram execute;          /**< Latency of the executes, in ns.*/
+  Histogram lag;              /**< How late the calls were, in ns.*/
+} ReplayThread;
+
+static uint64_t cost_ns;
+static double speed = 1;
+static Express *apps;
+static uint64_t start_ns;
+
+static inline void replay_work(void) {
+  if (!cost_ns)
+    return;
+  uint64_t end = bench_now_ns() + cost_ns;
+  while (bench_now_ns() < end)
+    ;
+}
+
+#define REPLAY_DEFINE(n)                                                       \
+  static ExpressCommand synthetic_##n(void) {                                  \
+    replay_work();                                                             \
+    return E_CONTINUE;                                                         \
+  }
+REPLAY_SYNTHETIC(REPLAY_DEFINE)
+
+#define REPLAY_ENTRY(n) synthetic_##n,
+static const ExpressCallback synthetic[] = {REPLAY_SYNTHETIC(REPLAY_ENTRY)};
+
+static void *xrealloc(void *ptr, size_t size) {
+  ptr = realloc(ptr, size);
+  if (!ptr) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/**
+ * @brief Waits until the scheduled time of an event.
+ *
+ * @param ns Offset of the event in the recording.
+ * @return How late the event is, in ns.
+ */
+static uint64_t replay_wait(uint64_t ns) {
+  uint64_t now = bench_now_ns();
+  if (!speed)
+    return 0;
+
+  uint64_t due = start_ns + (uint64_t)((double)ns / speed);
+  if (due > now + 100000) {
+    struct timespec ts = {.tv_sec = (time_t)((due - 50000) / 1000000000u),
+                          .tv_nsec = (long)((due - 50000) % 1000000000u)};
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    now = bench_now_ns();
+  }
+  while (now < due)
+    now = bench_now_ns();
+  return now - due;
+}
+
+static void *replay_run(void *arg) {
+  ReplayThread *thread = arg;
+  ExpressCallback *batch = NULL;
+  size_t room = 0;
+
+  for (size_t i = 0; i < thread->count; i++) {
+    const ExpressRecordEvent *event = &thread->events[i];
+    Express *app = &apps[event->app];
+
+    histogram_record(&thread->lag, replay_wait(event->ns));
+    uint64_t start = bench_now_ns();
+    switch (event->type) {
+    case E_RECORD_ADD:
+      express_add(app, synthetic[event->arg % REPLAY_CALLBACKS]);
+      histogram_record(&thread->add, bench_now_ns() - start);
+      break;
+    case E_RECORD_ADD_MANY: {
+      size_t n = 0;
+      if (event->arg > room) {
+        room = event->arg;
+        batch = xrealloc(batch, room * sizeof(ExpressCallback));
+      }
+      while (n < event->arg && i + 1 < thread->count &&
+             thread->events[i + 1].type == E_RECORD_CALLBACK)
+        batch[n++] = synthetic[thread->events[++i].arg % REPLAY_CALLBACKS];
+      express_add_many(app, batch, n);
+      histogram_record(&thread->add, bench_now_ns() - start);
+      break;
+    }
+    case E_RECORD_EXECUTE:
+      express_execute(app);
+      histogram_record(&thread->execute, bench_now_ns() - start);
+      break;
+    default:
+      break;
+    }
+  }
+
+  free(batch);
+  return NULL;
+}
+
+/**
+ * @brief Returns the replay thread of a recorded thread.
+ */
+static ReplayThread *replay_thread(ReplayThread **threads, size_t *count,
+                                   uint32_t tid) {
+  for (size_t i = 0; i < *count; i++)
+    if ((*threads)[i].tid == tid)
+      return &(*threads)[i];
+
+  *threads = xrealloc(*threads, (*count + 1) * sizeof(ReplayThread));
+  ReplayThread *thread = &(*threads)[(*count)++];
+  memset(thread, 0, sizeof(ReplayThread));
+  thread->tid = tid;
+  return thread;
+}
+
+static void merge(Histogram *into, const Histogram *from) {
+  into->count += from->count;
+  if (from->max > into->max)
+    into->max = from->max;
+  for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+    into->buckets[b] += from->buckets[b];
+}
+
+static void print_latency(const char *name, const Histogram *histogram) {
+  ExpressLatency latency = histogram_latency(histogram, 1.0);
+  printf(",\n \"%s\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, "
+         "\"max\": %llu}",
+         name, (unsigned long long)latency.p50,
+         (unsigned long long)latency.p99, (unsigned long long)latency.p999,
+         (unsigned long long)latency.max);
+}
+
+int main(int argc, char **argv) {
+  FILE *in = argc > 1 ? fopen(argv[1], "rb") : NULL;
+  if (!in) {
+    fprintf(stderr, "usage: %s file [speed] [cost ns]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  if (argc > 2)
+    speed = strtod(argv[2], NULL);
+
+  ExpressRecordHeader header;
+  if (fread(&header, sizeof(header), 1, in) != 1 ||
+      header.magic != EXPRESS_RECORD_MAGIC ||
+      header.version != EXPRESS_RECORD_VERSION ||
+      header.event_size != sizeof(ExpressRecordEvent)) {
+    fprintf(stderr, "%s: not a recording of this version\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  ReplayThread *threads = NULL;
+  size_t thread_count = 0, app_count = 0, ran = 0;
+  uint64_t executing_ns = 0;
+  for (uint64_t e = 0; e < header.events; e++) {
+    ExpressRecordEvent event;
+    if (fread(&event, sizeof(event), 1, in) != 1) {
+      fprintf(stderr, "%s: truncated after %llu events\n", argv[1],
+              (unsigned long long)e);
+      return EXIT_FAILURE;
+    }
+    if (event.app >= app_count)
+      app_count = event.app + 1u;
+    if (event.type == E_RECORD_EXECUTE) {
+      ran += event.arg;
+      executing_ns += event.value;
+    }
+
+    ReplayThread *thread = replay_thread(&threads, &thread_count, event.tid);
+    if (thread->count == thread->capacity) {
+      thread->capacity = thread->capacity ? thread->capacity * 2 : 1024;
+      thread->events = xrealloc(thread->events, thread->capacity *
+                                                    sizeof(ExpressRecordEvent));
+    }
+    thread->events[thread->count++] = event;
+  }
+  fclose(in);
+
+  cost_ns = argc > 3 ? strtoull(argv[3], NULL, 10)
+                     : (ran ? executing_ns / ran : 0);
+
+  apps = xrealloc(NULL, (app_count ? app_count : 1) * sizeof(Express));
+  for (size_t i = 0; i < app_count; i++)
+    apps[i] = express_create();
+
+  start_ns = bench_now_ns();
+  for (size_t i = 0; i < thread_count; i++)
+    if (pthread_create(&threads[i].thread, NULL, replay_run, &threads[i])) {
+      fprintf(stderr, "Failed to start a replay thread\n");
+      return EXIT_FAILURE;
+    }
+  for (size_t i = 0; i < thread_count; i++)
+    pthread_join(threads[i].thread, NULL);
+  uint64_t replayed_ns = bench_now_ns() - start_ns;
+
+  for (size_t i = 1; i < thread_count; i++) {
+    merge(&threads[0].add, &threads[i].add);
+    merge(&threads[0].execute, &threads[i].execute);
+    merge(&threads[0].lag, &threads[i].lag);
+  }
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"events\": %llu, \"threads\": %zu, \"apps\": %zu, "
+         "\"callbacks\": %u, \"speed\": %g, \"cost_ns\": %llu,\n"
+         " \"recorded_ms\": %.1f, \"replayed_ms\": %.1f",
+         (unsigned long long)header.events, thread_count, app_count,
+         header.callbacks, speed, (unsigned long long)cost_ns,
+         (double)header.duration_ns / 1e6, (double)replayed_ns / 1e6);
+  if (thread_count) {
+    print_latency("add_ns", &threads[0].add);
+    print_latency("execute_ns", &threads[0].execute);
+    print_latency("lag_ns", &threads[0].lag);
+  }
+  printf("\n}\n");
+
+  for (size_t i = 0; i < app_count; i++)
+    express_destroy(&apps[i]);
+  for (size_t i = 0; i < thread_count; i++)
+    free(threads[i].events);
+  free(threads);
+  free(apps);
+  return 0;
+}
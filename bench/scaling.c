@@ -0,0 +1,171 @@
+/**
+ * @file scaling.c
+ * @brief Throughput and latency of express_add as producers are added.
+ *
+ * Usage: `scaling [max producers] [consumers] [adds per producer]`
+ *
+ * For 1, 2, 4, ... up to the max producers (the number of CPUs by default),
+ * every producer calls express_add in a loop while the consumers (1 by
+ * default) call express_execute on the same Express object until all the
+ * callbacks ran.
+ *
+ * Each add is timed on its own and recorded into a Histogram of the
+ * producer, the histograms are merged for the percentiles. Consumers yield
+ * when they find the chain empty.
+ *
+ * Results are written to `stdout` as JSON, one entry per producer count:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "consumers": 1, "results": [{"producers": 1,
+ *   "adds_per_sec": 5.1e7, "executed_per_sec": 5.1e7, "add_ns":
+ *   {"p50": 20, "p99": 45, "p999": 900, "max": 12000}}, ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include "bench.h"
+
+/**
+ * @typedef Scaling
+ * @brief Shared state of one run.
+ */
+typedef struct Scaling {
+  Express app;                /**< Chain every thread works on.*/
+  size_t adds;                /**< Adds per producer.*/
+  atomic_size_t producing;    /**< Producers that did not finish yet.*/
+  atomic_uint_fast64_t executed; /**< Callbacks run by the consumers.*/
+  pthread_barrier_t start;    /**< Releases all the threads at once.*/
+} Scaling;
+
+/**
+ * @typedef Producer
+ * @brief State of one producer thread.
+ */
+typedef struct Producer {
+  Scaling *scaling;
+  Histogram latency; /**< Ticks spent in each express_add.*/
+} Producer;
+
+static _Thread_local uint64_t executed;
+
+static ExpressCommand count_callback(void) {
+  executed++;
+  return E_CONTINUE;
+}
+
+static void *producer(void *arg) {
+  Producer *producer = arg;
+  Scaling *scaling = producer->scaling;
+
+  pthread_barrier_wait(&scaling->start);
+  for (size_t i = 0; i < scaling->adds; i++) {
+    uint64_t start = express_ticks();
+    express_add(&scaling->app, count_callback);
+    histogram_record(&producer->latency, express_ticks() - start);
+  }
+  atomic_fetch_sub(&scaling->producing, 1);
+
+  return NULL;
+}
+
+static void *consumer(void *arg) {
+  Scaling *scaling = arg;
+
+  pthread_barrier_wait(&scaling->start);
+  for (;;) {
+    int last = !atomic_load(&scaling->producing);
+    uint64_t before = executed;
+    express_execute(&scaling->app);
+    if (last)
+      break;
+    if (executed == before)
+      sched_yield();
+  }
+  atomic_fetch_add(&scaling->executed, executed);
+
+  return NULL;
+}
+
+static void run(size_t producers, size_t consumers, size_t adds,
+                const char *separator) {
+  Scaling scaling = {.app = express_create(), .adds = adds};
+  atomic_init(&scaling.producing, producers);
+  atomic_init(&scaling.executed, 0);
+
+  Producer *states = calloc(producers, sizeof(Producer));
+  pthread_t *ids = malloc((producers + consumers) * sizeof(pthread_t));
+  if (!states || !ids) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  ExpressClock clock = express_clock_start();
+  pthread_barrier_init(&scaling.start, NULL, producers + consumers + 1);
+  for (size_t i = 0; i < producers; i++) {
+    states[i].scaling = &scaling;
+    pthread_create(&ids[i], NULL, producer, &states[i]);
+  }
+  for (size_t i = 0; i < consumers; i++)
+    pthread_create(&ids[producers + i], NULL, consumer, &scaling);
+
+  pthread_barrier_wait(&scaling.start);
+  uint64_t begin = bench_now_ns();
+  for (size_t i = 0; i < producers; i++)
+    pthread_join(ids[i], NULL);
+  uint64_t produced = bench_now_ns() - begin;
+  for (size_t i = 0; i < consumers; i++)
+    pthread_join(ids[producers + i], NULL);
+  uint64_t drained = bench_now_ns() - begin;
+
+  Histogram *merged = &states[0].latency;
+  for (size_t i = 1; i < producers; i++) {
+    merged->count += states[i].latency.count;
+    if (states[i].latency.max > merged->max)
+      merged->max = states[i].latency.max;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+      merged->buckets[b] += states[i].latency.buckets[b];
+  }
+  ExpressLatency latency =
+      histogram_latency(merged, express_clock_scale(&clock));
+
+  printf("%s  {\"producers\": %zu, \"adds_per_sec\": %.0f, "
+         "\"executed_per_sec\": %.0f, \"add_ns\": {\"p50\": %llu, "
+         "\"p99\": %llu, \"p999\": %llu, \"max\": %llu}}",
+         separator, producers, (double)(producers * adds) * 1e9 / produced,
+         (double)atomic_load(&scaling.executed) * 1e9 / drained,
+         (unsigned long long)latency.p50, (unsigned long long)latency.p99,
+         (unsigned long long)latency.p999, (unsigned long long)latency.max);
+  fflush(stdout);
+
+  pthread_barrier_destroy(&scaling.start);
+  express_destroy(&scaling.app);
+  free(states);
+  free(ids);
+}
+
+int main(int argc, char **argv) {
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_producers = argc > 1 ? strtoul(argv[1], NULL, 10)
+                                  : (cpus > 0 ? (size_t)cpus : 1);
+  size_t consumers = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+  size_t adds = argc > 3 ? strtoul(argv[3], NULL, 10) : 200000;
+
+  if (!max_producers || !consumers || !adds) {
+    fprintf(stderr, "usage: %s [max producers] [consumers] [adds per producer]\n",
+            argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"consumers\": %zu,\n \"results\": [", consumers);
+
+  size_t producers = 1;
+  for (; producers < max_producers; producers *= 2)
+    run(producers, consumers, adds, producers == 1 ? "\n" : ",\n");
+  run(max_producers, consumers, adds, producers == 1 ? "\n" : ",\n");
+  printf("\n]}\n");
+
+  return 0;
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Prints the ns/op of bench/micro builds side by side.
+
+Usage:
+    speedup.py REFERENCE RESULTS...
+
+Every RESULTS file gets a column with its ns/op and its speedup over the
+REFERENCE build, followed by the geometric mean speedup of all the results
+they have in common.
+"""
+
+import json
+import math
+import os
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        return {(r["name"], r["length"]): r["ns_per_op"]
+                for r in json.load(f)["results"]}
+
+
+def label(path):
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+def main(argv):
+    if len(argv) < 3:
+        sys.stderr.write(__doc__)
+        return 2
+
+    reference = load(argv[1])
+    runs = [(label(path), load(path)) for path in argv[2:]]
+    keys = sorted(set(reference).intersection(*(r for _, r in runs)))
+
+    header = "%-16s %9s %10s" % ("name", "length", label(argv[1]))
+    for name, _ in runs:
+        header += " %10s %8s" % (name, "speedup")
+    print(header)
+
+    logs = [0.0] * len(runs)
+    for k in keys:
+        line = "%-16s %9d %10.2f" % (k[0], k[1], reference[k])
+        for i, (_, run) in enumerate(runs):
+            speedup = reference[k] / run[k] if run[k] else float("inf")
+            logs[i] += math.log(speedup) if run[k] else 0.0
+            line += " %10.2f %7.2fx" % (run[k], speedup)
+        print(line)
+
+    line = "%-16s %9s %10s" % ("geometric mean", "", "")
+    for log in logs:
+        line += " %10s %7.2fx" % ("", math.exp(log / len(keys)) if keys else 1)
+    print(line)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
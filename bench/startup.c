@@ -0,0 +1,119 @@
+/**
+ * @file startup.c
+ * @brief Time to build a large chain, the cold start cost of a process.
+ *
+ * Usage: `startup [max entries]`
+ *
+ * For 10^3, 10^4 ... up to the max entries (10^7 by default), a fresh
+ * Express object is filled from an array of callbacks with each builder in
+ * turn:
+ *
+ * - `express_add` one call per entry, one lock and one malloc each.
+ * - `express_add_many` one lock, still one malloc per entry.
+ * - `express_build_from_array` one lock and a single allocation.
+ *
+ * Every build starts after `malloc_trim`, so it pays for fresh pages like
+ * a process that just started. Small chains are repeated until about
+ * STARTUP_MIN_ENTRIES entries were built. The chain is then executed once,
+ * outside of the build time, so the cost of draining a chain of each layout
+ * shows up too.
+ *
+ * Results are written to `stdout` as JSON:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.json}
+ * {"host": {...}, "results": [{"name": "express_build_from_array",
+ *   "entries": 1000000, "rounds": 1, "build_ms": 3.1, "ns_per_entry": 3.1,
+ *   "allocs_per_entry": 0.000001, "execute_ms": 6.2}, ...]}
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ */
+
+#include "../express.h"
+
+#include <malloc.h>
+
+#include "bench.h"
+
+/**
+ * @def STARTUP_MIN_ENTRIES
+ * @brief Entries built at least for each builder and size.
+ */
+#define STARTUP_MIN_ENTRIES 1000000
+
+/**
+ * @typedef StartupBuild
+ * @brief Fills a chain with the **n** callbacks of **cbs**.
+ */
+typedef void (*StartupBuild)(Express *app, const ExpressCallback *cbs,
+                             size_t n);
+
+static ExpressCommand noop_callback(void) { return E_CONTINUE; }
+
+static void build_add(Express *app, const ExpressCallback *cbs, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    express_add(app, cbs[i]);
+}
+
+static const struct {
+  const char *name;
+  StartupBuild build;
+} builders[] = {
+    {"express_add", build_add},
+    {"express_add_many", express_add_many},
+    {"express_build_from_array", express_build_from_array},
+};
+
+int main(int argc, char **argv) {
+  size_t max_entries = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+
+  ExpressCallback *cbs = malloc(max_entries * sizeof(ExpressCallback));
+  if (max_entries < 1000 || !cbs) {
+    fprintf(stderr, "usage: %s [max entries >= 1000]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < max_entries; i++)
+    cbs[i] = noop_callback;
+
+  printf("{\"host\": ");
+  bench_host_json(stdout);
+  printf(",\n \"results\": [");
+
+  const char *separator = "\n";
+  for (size_t n = 1000; n <= max_entries; n *= 10) {
+    for (size_t b = 0; b < sizeof(builders) / sizeof(builders[0]); b++) {
+      size_t rounds = n < STARTUP_MIN_ENTRIES ? STARTUP_MIN_ENTRIES / n : 1;
+      uint64_t build_ns = 0, execute_ns = 0, allocs = 0;
+
+      for (size_t r = 0; r < rounds; r++) {
+        malloc_trim(0);
+        Express app = express_create();
+
+        BenchAllocs at = bench_allocs;
+        uint64_t start = bench_now_ns();
+        builders[b].build(&app, cbs, n);
+        build_ns += bench_now_ns() - start;
+        allocs += bench_allocs.allocs - at.allocs;
+
+        start = bench_now_ns();
+        express_execute(&app);
+        execute_ns += bench_now_ns() - start;
+
+        express_destroy(&app);
+      }
+
+      double entries = (double)n * (double)rounds;
+      printf("%s  {\"name\": \"%s\", \"entries\": %zu, \"rounds\": %zu, "
+             "\"build_ms\": %.3f, \"ns_per_entry\": %.2f, "
+             "\"allocs_per_entry\": %.6f, \"execute_ms\": %.3f}",
+             separator, builders[b].name, n, rounds,
+             (double)build_ns / 1e6 / (double)rounds,
+             (double)build_ns / entries, (double)allocs / entries,
+             (double)execute_ns / 1e6 / (double)rounds);
+      separator = ",\n";
+      fflush(stdout);
+    }
+  }
+  printf("\n]}\n");
+
+  free(cbs);
+  return 0;
+}
@@ -0,0 +1,38 @@
+/**
+ * @file wrap.c
+ * @brief Allocator wrappers of the benchmarks.
+ *
+ * Linked into every benchmark together with `BENCH_LDFLAGS`, which makes the
+ * linker call these instead of the allocator, see bench.h.
+ */
+
+#include <stdlib.h>
+
+#include "bench.h"
+
+_Thread_local BenchAllocs bench_allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_aligned_alloc(size_t alignment, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) {
+  bench_allocs.allocs++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  bench_allocs.allocs++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_aligned_alloc(size_t alignment, size_t size) {
+  bench_allocs.allocs++;
+  return __real_aligned_alloc(alignment, size);
+}
+
+void __wrap_free(void *ptr) {
+  bench_allocs.frees += ptr != NULL;
+  __real_free(ptr);
+}
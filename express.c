@@ -1,374 +1,1967 @@
 /**
  * @file express.c
  * @brief Simple Express chain implementation.
+ *
+ * Built into `libexpress.a` and `libexpress.so`, the build options and the
+ * inline hot path are in express.h.
  */
 
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
+#include "express.h"
+
+#if defined(EXPRESS_TRACE) || defined(EXPRESS_WATCHDOG) ||                   \
+    defined(EXPRESS_RECORD)
+#include <dlfcn.h>
+#endif
+#ifdef EXPRESS_RECORD
+#include <errno.h>
+#endif
+#ifdef EXPRESS_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+#ifdef EXPRESS_SHM_STATS
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+/* =============== ABI ================== */
+
+const char EXPRESS_ABI = 0;
+
+/* =============== List Type ================== */
+
+void list_splice(List *list, List *other) {
+  if (!list || !other || !other->head)
+    return;
+
+  if (list->tail) {
+    list->tail->next = other->head;
+    other->head->prev = list->tail;
+  } else {
+    list->head = other->head;
+  }
+  list->tail = other->tail;
+  list->length += other->length;
+#ifdef EXPRESS_MEM_STATS
+  list->mem.allocations += other->mem.allocations;
+  list->mem.frees += other->mem.frees;
+  list->mem.bytes += other->mem.bytes;
+  list->mem.nodes += other->mem.nodes;
+  if (list->mem.nodes > list->mem.peak_nodes)
+    list->mem.peak_nodes = list->mem.nodes;
+  other->mem = (ListMemStats){0};
+#endif
+  if (other->blocks) {
+    NodeBlock **last = &list->blocks;
+    while (*last)
+      last = &(*last)->next;
+    *last = other->blocks;
+    other->blocks = NULL;
+  }
+
+  other->head = other->tail = NULL;
+  other->length = 0;
+}
+
+void list_clear(List *list) {
+  if (!list)
+    return;
+
+  list->tail = NULL;
+  list->length = 0;
+  while (list->head) {
+    Node *next = list->head->next;
+    list_release(list, list->head);
+    list->head = next;
+  }
+}
+
+/* =============== Histogram ================== */
+
+uint64_t histogram_percentile(const Histogram *histogram, double percentile) {
+  if (!histogram || !histogram->count)
+    return 0;
+
+  uint64_t rank = (uint64_t)(percentile / 100.0 * (double)histogram->count);
+  if (rank < 1)
+    rank = 1;
+  if (rank > histogram->count)
+    rank = histogram->count;
+
+  uint64_t seen = 0;
+  for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += histogram->buckets[i];
+    if (seen >= rank) {
+      uint64_t value = histogram_value(i);
+      return value < histogram->max ? value : histogram->max;
+    }
+  }
+
+  return histogram->max;
+}
+
+ExpressLatency histogram_latency(const Histogram *histogram, double scale) {
+  ExpressLatency latency = {0};
+  if (!histogram)
+    return latency;
+
+  latency.count = histogram->count;
+  latency.p50 = (uint64_t)(histogram_percentile(histogram, 50.0) * scale);
+  latency.p99 = (uint64_t)(histogram_percentile(histogram, 99.0) * scale);
+  latency.p999 = (uint64_t)(histogram_percentile(histogram, 99.9) * scale);
+  latency.max = (uint64_t)(histogram->max * scale);
+  return latency;
+}
 
+/* =============== Profile ================== */
+
+#ifdef EXPRESS_PROFILE
 /**
- * @typedef Node
- * @brief Represents a linked list node.
- * @see Node
- *
- * @struct Node
- * @brief Represents doubly linked list node.
- * @see node_create
+ * @brief Allocates an empty ExpressProfile in heap.
  *
- * Use create_node function to allocate one.
- *
- * To free just call the **stdlib** `free()` function.
+ * @return Pointer to the profile, free it with express_profile_free.
  */
-typedef struct Node {
-  void *value;       /**< Pointer to the linked list node value */
-  struct Node *next; /**< Pointer to the linked list next node */
-  struct Node *prev; /**< Pointer to the linked list previous node */
-} Node;
+static ExpressProfile *express_profile_create(void) {
+  ExpressProfile *profile = calloc(1, sizeof(ExpressProfile));
+  if (!profile) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  profile->clock = express_clock_start();
+  return profile;
+}
 
 /**
- * @typedef List
- * @brief Represents a doubly linked list.
- * @see List
+ * @brief Frees an ExpressProfile and all of its statistics.
  *
- * @struct List
- * @brief Represents a doubly linked list data structure.
- * @see list_push
- * @see list_shift
- * @see list_clear
+ * @param profile Pointer to ExpressProfile, may be **NULL**.
+ */
+static void express_profile_free(ExpressProfile *profile) {
+  if (!profile)
+    return;
+
+  for (size_t i = 0; i < EXPRESS_PROFILE_CALLBACKS; i++)
+    free(profile->callbacks[i]);
+  free(profile);
+}
+
+/**
+ * @brief Finds the statistics of a callback.
  *
- * You don't have to allocate it.
+ * @param profile Pointer to ExpressProfile.
+ * @param cb Pointer to ExpressCallback function.
+ * @param create Allocate the statistics if the callback is not in the table.
+ * @return Pointer to the statistics, **NULL** if not found or the table is
+ * full.
+ */
+static ExpressCallbackStats *express_profile_find(ExpressProfile *profile,
+                                                  ExpressCallback cb,
+                                                  int create) {
+  uintptr_t key = (uintptr_t)cb;
+  size_t mask = EXPRESS_PROFILE_CALLBACKS - 1;
+  size_t index = (size_t)((key >> 4) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+
+  for (size_t probe = 0; probe < EXPRESS_PROFILE_CALLBACKS; probe++) {
+    ExpressCallbackStats **entry = &profile->callbacks[(index + probe) & mask];
+    if (*entry && (*entry)->cb == cb)
+      return *entry;
+    if (*entry)
+      continue;
+    if (!create)
+      return NULL;
+
+    *entry = calloc(1, sizeof(ExpressCallbackStats));
+    if (!*entry) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    (*entry)->cb = cb;
+    return *entry;
+  }
+
+  return NULL;
+}
+
+#endif /* EXPRESS_PROFILE */
+
+#ifdef EXPRESS_HISTOGRAMS
+/**
+ * @brief Records one run of a callback.
  *
- * But don't forget to call `list_clear(*List)` to free any remaining nodes,
- * as nodes created in *heap*.
+ * @param profile Pointer to ExpressProfile.
+ * @param cb Pointer to the ExpressCallback function that ran.
+ * @param ticks Run time in clock ticks.
+ */
+static inline void express_profile_record(ExpressProfile *profile,
+                                          ExpressCallback cb, uint64_t ticks) {
+  ExpressCallbackStats *stats = express_profile_find(profile, cb, 1);
+  if (stats)
+    histogram_record(&stats->latency, ticks);
+  else
+    profile->dropped++;
+}
+#endif /* EXPRESS_HISTOGRAMS */
+
+/* =============== Perf Counters ================== */
+
+#ifdef EXPRESS_PERF_COUNTERS
+/**
+ * @typedef ExpressPerfRead
+ * @brief Layout of a `read` on a group leader with PERF_FORMAT_GROUP.
  */
-typedef struct List {
-  Node *head; /**< aaa */
-  Node *tail; /**< adds */
-} List;
+typedef struct ExpressPerfRead {
+  uint64_t nr;                          /**< Number of values.*/
+  uint64_t values[EXPRESS_PERF_EVENTS]; /**< One value per group member.*/
+} ExpressPerfRead;
+
+static const uint64_t express_perf_hardware[EXPRESS_PERF_EVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    PERF_COUNT_HW_CACHE_MISSES,
+};
+
+static const uint64_t express_perf_software[EXPRESS_PERF_EVENTS] = {
+    PERF_COUNT_SW_TASK_CLOCK,
+    PERF_COUNT_SW_CONTEXT_SWITCHES,
+    PERF_COUNT_SW_PAGE_FAULTS,
+    PERF_COUNT_SW_CPU_MIGRATIONS,
+};
+
+static const char *express_perf_names[2][EXPRESS_PERF_EVENTS] = {
+    {"cycles", "instructions", "branch-miss", "cache-miss"},
+    {"task-clock", "ctx-switch", "page-fault", "migration"},
+};
+
+/** Group leader of the calling thread, -2 until opened, -1 if unavailable.*/
+static _Thread_local int express_perf_fd = -2;
+
+/** Every counter of the group of the calling thread, leader first.*/
+static _Thread_local int express_perf_fds[EXPRESS_PERF_EVENTS];
+
+/** Counter type used by the process: 0 unknown, PERF_TYPE_HARDWARE or
+ * PERF_TYPE_SOFTWARE + 1, -1 if nothing could be opened.*/
+static atomic_int express_perf_type = 0;
 
 /**
- * @typedef ExpressCommand
- * @brief Represents command for the Express chain execute function.
+ * @brief Opens one counter group on the calling thread.
  *
- * @enum ExpressCommand
- * @brief Represents command for the Express chain execute function.
- * @see ExpressCallback
- * @see express_execute
+ * @param type PERF_TYPE_HARDWARE or PERF_TYPE_SOFTWARE.
+ * @param fds Receives the file descriptor of every counter, leader first.
+ * @return File descriptor of the group leader, -1 on failure.
  */
-typedef enum ExpressCommand {
-  E_CONTINUE, /**< Continue chain execution */
-  E_TRIGGER,  /**< Trigger stop action */
-} ExpressCommand;
+static int express_perf_open_group(uint32_t type,
+                                   int fds[EXPRESS_PERF_EVENTS]) {
+  const uint64_t *configs = type == PERF_TYPE_HARDWARE ? express_perf_hardware
+                                                       : express_perf_software;
+
+  for (size_t i = 0; i < EXPRESS_PERF_EVENTS; i++) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = configs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1,
+                          i ? fds[0] : -1, 0);
+    if (fds[i] < 0) {
+      while (i--)
+        close(fds[i]);
+      return -1;
+    }
+  }
+
+  return fds[0];
+}
 
 /**
- * @typedef Express
- * @brief Object that stores chain of callbacks and executes them one after the
- * other.
- * @see Express
+ * @brief Closes every counter of a group.
  *
- * @struct Express
- * @brief Object that stores chain of callbacks and executes them one after the
- * other.
+ * @param fds File descriptors filled by express_perf_open_group.
+ */
+static void express_perf_close_group(int fds[EXPRESS_PERF_EVENTS]) {
+  for (size_t i = EXPRESS_PERF_EVENTS; i--;)
+    close(fds[i]);
+}
+
+#ifndef EXPRESS_SINGLE_THREADED
+static pthread_key_t express_perf_key;
+static pthread_once_t express_perf_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Closes the counter group of a thread when it exits.
  *
- * @see List
- * @see express_create
- * @see express_add
- * @see express_destroy
+ * @param fds The express_perf_fds of the exiting thread.
+ */
+static void express_perf_thread_exit(void *fds) {
+  express_perf_close_group(fds);
+  express_perf_fd = -2;
+}
+
+static void express_perf_key_create(void) {
+  pthread_key_create(&express_perf_key, express_perf_thread_exit);
+}
+#endif
+
+/**
+ * @brief Opens the counter group of the calling thread on first use.
  *
- * You don't have to allocate this object in heap.
- * Just create it by using `Express express_create()` function.
+ * @return File descriptor of the group leader, -1 if unavailable.
  *
- * Don't forget to call `express_destory(*Express)`, this function just make
- * sure that no linked list nodes remain in the heap.
+ * The first thread picks hardware events, or software events if there is
+ * no usable PMU, and all the other threads follow its choice so the counts
+ * of a callback always mean the same thing. The group is closed when the
+ * thread exits.
+ */
+static int express_perf_thread_fd(void) {
+  if (express_perf_fd != -2)
+    return express_perf_fd;
+
+  int type = atomic_load_explicit(&express_perf_type, memory_order_acquire);
+  int fd = -1;
+
+  if (type > 0) {
+    fd = express_perf_open_group((uint32_t)type - 1, express_perf_fds);
+  } else if (type == 0) {
+    fd = express_perf_open_group(PERF_TYPE_HARDWARE, express_perf_fds);
+    type = PERF_TYPE_HARDWARE + 1;
+    if (fd < 0) {
+      fd = express_perf_open_group(PERF_TYPE_SOFTWARE, express_perf_fds);
+      type = fd >= 0 ? PERF_TYPE_SOFTWARE + 1 : -1;
+    }
+
+    int unknown = 0;
+    if (!atomic_compare_exchange_strong_explicit(
+            &express_perf_type, &unknown, type, memory_order_release,
+            memory_order_acquire) &&
+        unknown != type) {
+      if (fd >= 0)
+        express_perf_close_group(express_perf_fds);
+      express_perf_fd = -2;
+      return express_perf_thread_fd();
+    }
+  }
+
+#ifndef EXPRESS_SINGLE_THREADED
+  if (fd >= 0) {
+    pthread_once(&express_perf_once, express_perf_key_create);
+    pthread_setspecific(express_perf_key, express_perf_fds);
+  }
+#endif
+  express_perf_fd = fd;
+  return fd;
+}
+
+/**
+ * @brief Reads the counters of the calling thread.
  *
- * This object is **thread safe**.
+ * @param sample Receives the counter values.
+ * @return Non zero on success.
  */
-typedef struct Express {
-  List chain; /**< Linked list object that stores all the callback functions.*/
-  pthread_mutex_t lock; /**< Muxtex Lock for thread safety.*/
-} Express;
+static inline int express_perf_read(ExpressPerfRead *sample) {
+  int fd = express_perf_thread_fd();
+  return fd >= 0 && read(fd, sample, sizeof(*sample)) == sizeof(*sample);
+}
 
 /**
- * @typedef ExpressCallback
- * @brief A callback that passed to *express_add*.
- * @param ExpressCommand Pointer to ExpressCallback function.
- * @see express_add
- * @see ExpressCommand
+ * @brief Adds the counts of one callback run.
  *
- * @return ExpressCommand that tells the Express chain executer what to do next.
+ * @param profile Pointer to ExpressProfile.
+ * @param cb Pointer to the ExpressCallback function that ran.
+ * @param before Counters read right before the run.
+ * @param after Counters read right after the run.
  */
-typedef ExpressCommand (*ExpressCallback)(void);
+static void express_perf_record(ExpressProfile *profile, ExpressCallback cb,
+                                const ExpressPerfRead *before,
+                                const ExpressPerfRead *after) {
+  ExpressCallbackStats *stats = express_profile_find(profile, cb, 1);
+  if (!stats) {
+    profile->dropped++;
+    return;
+  }
 
-/* =============== Function Prototypes ================== */
+  stats->perf.runs++;
+  for (size_t i = 0; i < EXPRESS_PERF_EVENTS; i++)
+    stats->perf.values[i] += after->values[i] - before->values[i];
+}
 
 /**
- * @brief Creates an empty Express object.
- *
- * @return An empty Express object, that is allocated on the stack.
+ * @brief Tells if the counters are software events.
  */
-Express express_create();
+static int express_perf_is_software(void) {
+  return atomic_load_explicit(&express_perf_type, memory_order_acquire) ==
+         PERF_TYPE_SOFTWARE + 1;
+}
+#endif /* EXPRESS_PERF_COUNTERS */
+
+/* =============== Trace ================== */
+
+#ifdef EXPRESS_TRACE
+static _Atomic(ExpressTraceRing *) express_trace_rings = NULL;
+static _Thread_local ExpressTraceRing *express_trace_ring = NULL;
+
+#ifndef EXPRESS_SINGLE_THREADED
+static pthread_key_t express_trace_key;
+static pthread_once_t express_trace_once = PTHREAD_ONCE_INIT;
 
 /**
- * @brief Adds ExpressCallback to the chain of execution.
- *
- * @param app Pointer to Express object.
- * @param cb Pointer to ExpressCallback function to add to the chain.
+ * @brief Releases the ring of a thread when it exits.
  *
- * This function is *Thread Safe*.
+ * @param ring The ExpressTraceRing of the exiting thread.
  */
-void express_add(Express *app, ExpressCallback cb);
+static void express_trace_thread_exit(void *ring) {
+  atomic_store_explicit(&((ExpressTraceRing *)ring)->owned, 0,
+                        memory_order_release);
+  express_trace_ring = NULL;
+}
+
+static void express_trace_key_create(void) {
+  pthread_key_create(&express_trace_key, express_trace_thread_exit);
+}
+#endif
 
 /**
- * @brief Executes the Express chain.
- *
- * @param app Pointer to Express object.
+ * @brief Takes over the ring of an exited thread.
  *
- * This function is *Thread Safe*.
+ * @return Pointer to the ExpressTraceRing, **NULL** if every ring is owned.
  */
-void express_execute(Express *app);
+static ExpressTraceRing *express_trace_reuse(void) {
+  ExpressTraceRing *ring =
+      atomic_load_explicit(&express_trace_rings, memory_order_acquire);
+  for (; ring; ring = ring->next) {
+    int owned = 0;
+    if (atomic_compare_exchange_strong_explicit(&ring->owned, &owned, 1,
+                                                memory_order_acquire,
+                                                memory_order_relaxed))
+      return ring;
+  }
+  return NULL;
+}
 
 /**
- * @brief Cleans any heap nodes created for the chain.
+ * @brief Gives the calling thread a ring, reused or new, and publishes it.
  *
- * @param app Pointer to Express object.
+ * @return Pointer to the ExpressTraceRing of the thread.
  */
-void express_destroy(Express *app);
+static ExpressTraceRing *express_trace_register(void) {
+  ExpressTraceRing *ring = express_trace_reuse();
+  if (!ring) {
+    ring = calloc(1, sizeof(ExpressTraceRing));
+    if (!ring) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    atomic_init(&ring->owned, 1);
+    ring->tid = gettid();
+    ring->clock = express_clock_start();
+
+    ring->next =
+        atomic_load_explicit(&express_trace_rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&express_trace_rings,
+                                                  &ring->next, ring,
+                                                  memory_order_release,
+                                                  memory_order_relaxed))
+      ;
+  } else {
+    /* Events of the previous owner are dropped rather than given its tid. */
+    ring->tid = gettid();
+    ring->clock = express_clock_start();
+    atomic_store_explicit(
+        &ring->first, atomic_load_explicit(&ring->head, memory_order_relaxed),
+        memory_order_release);
+  }
+
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_once(&express_trace_once, express_trace_key_create);
+  pthread_setspecific(express_trace_key, ring);
+#endif
+  express_trace_ring = ring;
+  return ring;
+}
+
+void express_trace(ExpressTraceType type, ExpressCallback cb, uint32_t arg,
+                   uint64_t ticks) {
+  ExpressTraceRing *ring = express_trace_ring;
+  if (!ring)
+    ring = express_trace_register();
+
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  ExpressTraceEvent *event = &ring->events[head & (EXPRESS_TRACE_EVENTS - 1)];
+  event->ticks = ticks;
+  event->cb = cb;
+  event->type = type;
+  event->arg = arg;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
 
 /**
- * @brief ExpressCallback function that prints hello.
- * @see express_add
+ * @brief Writes the name of a callback as a JSON string.
  *
- * @return E_CONTINUE as an ExpressCommand to continue chain exection.
+ * @param out Stream to write to.
+ * @param cb Pointer to ExpressCallback function.
  */
-ExpressCommand hello_callback(void);
+static void express_trace_name(FILE *out, ExpressCallback cb) {
+  Dl_info info;
+
+  if (dladdr((void *)cb, &info) && info.dli_sname)
+    fprintf(out, "\"%s\"", info.dli_sname);
+  else
+    fprintf(out, "\"%p\"", (void *)cb);
+}
 
 /**
- * @brief ExpressCallback that prints out.
- * @see express_add
+ * @brief Writes one trace event as a JSON object.
+ *
+ * @param out Stream to write to.
+ * @param ring Ring the event belongs to.
+ * @param event Pointer to the event.
+ * @param scale Nanoseconds per clock tick of the ring.
  *
- * @return E_CONTINUE as an ExpressCommand to continue chain exection.
+ * Timestamps are monotonic clock microseconds, so the rings of all the
+ * threads share the same time line.
  */
-ExpressCommand out_callback(void);
+static void express_trace_write(FILE *out, const ExpressTraceRing *ring,
+                                const ExpressTraceEvent *event, double scale) {
+  static const char *phases[] = {"i", "i", "B", "E", "B", "E"};
+  double ticks = (double)(int64_t)(event->ticks - ring->clock.ticks);
+  double us = ((double)ring->clock.ns + ticks * scale) / 1e3;
+
+  fprintf(out, "{\"ph\":\"%s\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d,",
+          phases[event->type], us, (int)getpid(), (int)ring->tid);
+  fprintf(out, "\"cat\":\"express\",\"name\":");
+
+  switch (event->type) {
+  case E_TRACE_ADD:
+    fprintf(out, "\"express_add\",\"s\":\"t\",\"args\":{\"cb\":");
+    express_trace_name(out, event->cb);
+    fprintf(out, "}");
+    break;
+  case E_TRACE_ADD_MANY:
+    fprintf(out, "\"express_add_many\",\"s\":\"t\",\"args\":{\"n\":%u}",
+            event->arg);
+    break;
+  case E_TRACE_EXECUTE_BEGIN:
+  case E_TRACE_EXECUTE_END:
+    fprintf(out, "\"express_execute\"");
+    break;
+  case E_TRACE_BEGIN:
+    express_trace_name(out, event->cb);
+    break;
+  case E_TRACE_END:
+    express_trace_name(out, event->cb);
+    fprintf(out, ",\"args\":{\"cmd\":\"%s\"}",
+            event->arg == E_TRIGGER ? "E_TRIGGER" : "E_CONTINUE");
+    break;
+  }
+
+  fprintf(out, "}");
+}
 
 /**
- * @brief ExpressCallback that prints trigger.
- * @see express_add
+ * @brief Writes the events of every thread as Chrome trace-event JSON.
+ *
+ * @param out Stream to write to.
+ * @return Number of events written.
  *
- * @return E_TRIGGER as an ExpressCommand to stop chain exection.
+ * Each event is copied out of its ring before it is written, then the ring
+ * head is read again: events the owner may have overwritten in between are
+ * dropped instead of written torn.
  */
-ExpressCommand trigger_callback(void);
+size_t express_trace_dump(FILE *out) {
+  if (!out)
+    return 0;
 
-/* =============== Main ================== */
+  size_t written = 0;
 
-int main(void) {
-  Express app = express_create();
+  fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
 
-  express_add(&app, hello_callback);
-  express_add(&app, trigger_callback);
-  express_add(&app, out_callback);
+  ExpressTraceRing *ring =
+      atomic_load_explicit(&express_trace_rings, memory_order_acquire);
+  for (; ring; ring = ring->next) {
+    uint64_t first = atomic_load_explicit(&ring->first, memory_order_acquire);
+    double scale = express_clock_scale(&ring->clock);
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t tail =
+        head > EXPRESS_TRACE_EVENTS ? head - EXPRESS_TRACE_EVENTS : 0;
+    if (tail < first)
+      tail = first;
 
-  express_execute(&app);
-  express_destroy(&app);
+    for (uint64_t i = tail; i < head; i++) {
+      ExpressTraceEvent event = ring->events[i & (EXPRESS_TRACE_EVENTS - 1)];
+      atomic_thread_fence(memory_order_acquire);
+      uint64_t now = atomic_load_explicit(&ring->head, memory_order_relaxed);
+      /* Event i + N is written into the slot before head leaves i + N. */
+      if (now - i >= EXPRESS_TRACE_EVENTS)
+        continue;
 
-  return 0;
+      if (written++)
+        fprintf(out, ",");
+      fprintf(out, "\n");
+      express_trace_write(out, ring, &event, scale);
+    }
+  }
+
+  fprintf(out, "\n]}\n");
+  return written;
 }
+#endif /* EXPRESS_TRACE */
 
-ExpressCommand hello_callback() {
-  printf("Hello\n");
-  return E_CONTINUE;
+/* =============== Record ================== */
+
+#ifdef EXPRESS_RECORD
+/**
+ * @brief State of the recording.
+ *
+ * ExpressRecorder::lock serializes the writes to the file and protects the
+ * callback numbers.
+ */
+static struct ExpressRecorder {
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_t lock; /**< Protects everything but on and buffers.*/
+#endif
+  FILE *out;                  /**< Recording, **NULL** when stopped.*/
+  atomic_int on;              /**< Calls are being recorded.*/
+  uint64_t start_ns;          /**< express_now_ns at the start.*/
+  uint64_t events;            /**< Events written so far.*/
+  ExpressCallback *callbacks; /**< Callback of each number.*/
+  uint32_t count;             /**< Callbacks numbered so far.*/
+  uint32_t capacity;          /**< Room in callbacks.*/
+  _Atomic(ExpressRecordBuffer *) buffers; /**< Buffers of every thread.*/
+} express_recorder
+#ifndef EXPRESS_SINGLE_THREADED
+    = {.lock = PTHREAD_MUTEX_INITIALIZER}
+#endif
+;
+
+static _Thread_local ExpressRecordBuffer *express_record_buffer = NULL;
+
+static void express_record_lock(void) {
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_lock(&express_recorder.lock);
+#endif
 }
 
-ExpressCommand out_callback() {
-  printf("Out\n");
-  return E_CONTINUE;
+static void express_record_unlock(void) {
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_unlock(&express_recorder.lock);
+#endif
 }
 
-ExpressCommand trigger_callback() {
-  printf("Trigger\n");
-  return E_TRIGGER;
+/**
+ * @brief Hands out the number of a new Express object.
+ *
+ * @return Number of the object in recordings, wraps after 65535.
+ */
+static uint16_t express_record_id(void) {
+  static atomic_uint next = 0;
+  return (uint16_t)atomic_fetch_add_explicit(&next, 1, memory_order_relaxed);
 }
 
-/* =============== Node Type ================== */
+#ifndef EXPRESS_SINGLE_THREADED
+static pthread_key_t express_record_key;
+static pthread_once_t express_record_once = PTHREAD_ONCE_INIT;
 
 /**
- * @brief Allocates a new Node object in heap.
+ * @brief Releases the buffer of a thread when it exits.
  *
+ * @param buffer The ExpressRecordBuffer of the exiting thread.
+ */
+static void express_record_thread_exit(void *buffer) {
+  atomic_store_explicit(&((ExpressRecordBuffer *)buffer)->owned, 0,
+                        memory_order_release);
+  express_record_buffer = NULL;
+}
+
+static void express_record_key_create(void) {
+  pthread_key_create(&express_record_key, express_record_thread_exit);
+}
+#endif
+
+/**
+ * @brief Takes over the buffer of an exited thread.
  *
- * @param value Pointer to the value holded by the node.
- * @param next Pointer to the next node.
- * @param prev Pointer to the previous node.
- * @return Pointer to the heap allocated Node object.
- * @see Node
+ * @return Pointer to the ExpressRecordBuffer, **NULL** if every buffer is
+ * owned.
+ */
+static ExpressRecordBuffer *express_record_reuse(void) {
+  ExpressRecordBuffer *buffer =
+      atomic_load_explicit(&express_recorder.buffers, memory_order_acquire);
+  for (; buffer; buffer = buffer->next) {
+    int owned = 0;
+    if (atomic_compare_exchange_strong_explicit(&buffer->owned, &owned, 1,
+                                                memory_order_acquire,
+                                                memory_order_relaxed))
+      return buffer;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Gives the calling thread a buffer, reused or new, and publishes it.
  *
- * Don't forget to free the Node by calling `free(*Node)`
+ * @return Pointer to the ExpressRecordBuffer of the thread.
  */
-Node *node_create(void *value, Node *next, Node *prev) {
-  Node *node = malloc(sizeof(Node));
-  if (!node) {
-    fprintf(stderr, "Failed to allocate memory\n");
-    exit(EXIT_FAILURE);
+static ExpressRecordBuffer *express_record_register(void) {
+  ExpressRecordBuffer *buffer = express_record_reuse();
+  if (!buffer) {
+    buffer = calloc(1, sizeof(ExpressRecordBuffer));
+    if (!buffer) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    atomic_init(&buffer->owned, 1);
+
+    buffer->next =
+        atomic_load_explicit(&express_recorder.buffers, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&express_recorder.buffers,
+                                                  &buffer->next, buffer,
+                                                  memory_order_release,
+                                                  memory_order_relaxed))
+      ;
   }
+  buffer->tid = (uint32_t)gettid();
 
-  node->value = value;
-  node->next = next;
-  node->prev = prev;
-  return node;
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_once(&express_record_once, express_record_key_create);
+  pthread_setspecific(express_record_key, buffer);
+#endif
+  express_record_buffer = buffer;
+  return buffer;
 }
 
-/* =============== List Type ================== */
-
 /**
- * @brief Pushes/Adds a new value to the list
+ * @brief Returns the number of a callback in the recording.
  *
- * @param list Pointer to List.
- * @param value Pointer to the value.
- * @see List
- * @see Node
- * @see node_create
- * @see Express::chain
+ * @param cb Pointer to ExpressCallback function.
+ * @return Number of **cb**, a new one the first time it is seen.
  *
- * Creates a new node using node_create then pushes the node to the end of the
- * List.
+ * Called with ExpressRecorder::lock held.
  */
-void list_push(List *list, void *value) {
-  if (!list || !value)
-    return;
-
-  Node *node = node_create(value, NULL, list->tail);
-  if (!node)
-    return;
+static uint32_t express_record_number(ExpressCallback cb) {
+  for (uint32_t i = 0; i < express_recorder.count; i++)
+    if (express_recorder.callbacks[i] == cb)
+      return i;
 
-  if (list->tail) {
-    list->tail->next = node;
-    list->tail = node;
-  } else {
-    list->head = node;
-    list->tail = node;
+  if (express_recorder.count == express_recorder.capacity) {
+    uint32_t capacity =
+        express_recorder.capacity ? express_recorder.capacity * 2 : 64;
+    ExpressCallback *callbacks = realloc(express_recorder.callbacks,
+                                         capacity * sizeof(ExpressCallback));
+    if (!callbacks) {
+      fprintf(stderr, "Failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    express_recorder.callbacks = callbacks;
+    express_recorder.capacity = capacity;
   }
+  express_recorder.callbacks[express_recorder.count] = cb;
+  return express_recorder.count++;
 }
 
 /**
- * @brief Frees Node objects from heap.
+ * @brief Writes the buffered events of a thread to the recording.
  *
- * @param list Pointer to List to clear and free.
- * @see List
- * @see Express::chain
+ * @param buffer Pointer to ExpressRecordBuffer.
  *
- * Just freese the Node object, you must handle Node::value on your own.
+ * Called with ExpressRecorder::lock held. Events are dropped when no
+ * recording is running.
  */
-void list_clear(List *list) {
-  if (!list)
-    return;
+static void express_record_write(ExpressRecordBuffer *buffer) {
+  uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+  uint64_t written =
+      atomic_load_explicit(&buffer->written, memory_order_relaxed);
 
-  list->tail = NULL;
-  while (list->head) {
-    Node *next = list->head->next;
-    free(list->head);
-    list->head = next;
+  for (; express_recorder.out && written < head; written++) {
+    size_t i = written & (EXPRESS_RECORD_EVENTS - 1);
+    ExpressRecordEvent *event = &buffer->events[i];
+    if (event->type == E_RECORD_ADD || event->type == E_RECORD_CALLBACK)
+      event->arg = express_record_number(buffer->cbs[i]);
+    fwrite(event, sizeof(ExpressRecordEvent), 1, express_recorder.out);
+    express_recorder.events++;
   }
+  atomic_store_explicit(&buffer->written, head, memory_order_release);
 }
 
 /**
- * @brief Pops the first Node from the beginning of the chain.
- *
- * @param list Pointer to the List to pop from.
- * @return Pointer to the value holded by the popped Node.
- * @see Node
- *
- * The value is never allocated or freed by the list functions.
- * Do it on your own.
- *
- * Simple example to free all values holded by the linked list.
+ * @brief Buffers an event of the calling thread.
  *
- * ~~~~~~~~~~~~~~~~~~~~~{.c}
- * Express app = express_create();
- * ...
- * void *value = NULL;
+ * @param app Pointer to the Express object of the event.
+ * @param type Kind of the event.
+ * @param ns express_now_ns of the event.
+ * @param cb Callback of the event, may be **NULL**.
+ * @param arg Batch size or callbacks run.
+ * @param value Nanoseconds an execute took.
+ * @param cmd ExpressCommand an execute returned.
  *
- * while (value = list_shift(&app.chain)) {
- *  free(value);
- * }
- * ~~~~~~~~~~~~~~~~~~~~~~
+ * Writes the buffer first when it is full.
+ */
+static void express_record_push(Express *app, ExpressRecordType type,
+                                uint64_t ns, ExpressCallback cb, uint32_t arg,
+                                uint32_t value, ExpressCommand cmd) {
+  ExpressRecordBuffer *buffer = express_record_buffer;
+  if (!buffer)
+    buffer = express_record_register();
+
+  uint64_t head = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+  if (head - atomic_load_explicit(&buffer->written, memory_order_acquire) ==
+      EXPRESS_RECORD_EVENTS) {
+    express_record_lock();
+    express_record_write(buffer);
+    express_record_unlock();
+  }
+
+  size_t i = head & (EXPRESS_RECORD_EVENTS - 1);
+  uint64_t start = express_recorder.start_ns;
+  buffer->cbs[i] = cb;
+  buffer->events[i] = (ExpressRecordEvent){
+      .ns = ns > start ? ns - start : 0,
+      .tid = buffer->tid,
+      .app = app->record_id,
+      .type = (uint8_t)type,
+      .cmd = (uint8_t)cmd,
+      .arg = arg,
+      .value = value,
+  };
+  atomic_store_explicit(&buffer->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Tells if calls are being recorded.
  *
- * The previous example could fail if a value was set as *NULL*.
- * So, implement your types well.
+ * @return Non zero between express_record_start and express_record_stop.
  */
-void *list_shift(List *list) {
-  if (!list || !list->tail)
-    return NULL;
+static inline int express_recording(void) {
+  return atomic_load_explicit(&express_recorder.on, memory_order_acquire);
+}
+
+void express_record_add(Express *app, ExpressCallback cb) {
+  if (express_recording())
+    express_record_push(app, E_RECORD_ADD, express_now_ns(), cb, 0, 0,
+                        E_CONTINUE);
+}
+
+void express_record_many(Express *app, const ExpressCallback *cbs, size_t n) {
+  if (!express_recording())
+    return;
+
+  uint64_t ns = express_now_ns();
+  uint32_t count = 0;
+  for (size_t i = 0; i < n; i++)
+    count += cbs[i] != NULL;
+
+  express_record_push(app, E_RECORD_ADD_MANY, ns, NULL, count, 0, E_CONTINUE);
+  for (size_t i = 0; i < n; i++)
+    if (cbs[i])
+      express_record_push(app, E_RECORD_CALLBACK, ns, cbs[i], 0, 0,
+                          E_CONTINUE);
+}
+
+void express_record_execute(Express *app, uint64_t start_ns, size_t ran,
+                            ExpressCommand cmd) {
+  if (!express_recording())
+    return;
+
+  uint64_t elapsed = express_now_ns() - start_ns;
+  express_record_push(app, E_RECORD_EXECUTE, start_ns, NULL, (uint32_t)ran,
+                      elapsed < UINT32_MAX ? (uint32_t)elapsed : UINT32_MAX,
+                      cmd);
+}
 
-  Node *node = list->head;
-  if (list->head == list->tail)
-    list->head = list->tail = NULL;
-  else {
-    node->next->prev = NULL;
-    list->head = node->next;
+int express_record_start(const char *path) {
+  FILE *out = fopen(path, "wb");
+  if (!out)
+    return errno;
+
+  express_record_lock();
+  if (express_recorder.out) {
+    express_record_unlock();
+    fclose(out);
+    return EBUSY;
   }
 
-  void *value = node->value;
-  free(node);
-  return value;
+  ExpressRecordHeader header = {
+      .magic = EXPRESS_RECORD_MAGIC,
+      .version = EXPRESS_RECORD_VERSION,
+      .event_size = sizeof(ExpressRecordEvent),
+  };
+  fwrite(&header, sizeof(header), 1, out);
+  express_recorder.out = out;
+  express_recorder.events = 0;
+  express_recorder.count = 0;
+
+  /* Drop what a previous recording left behind. */
+  for (ExpressRecordBuffer *buffer = atomic_load_explicit(
+           &express_recorder.buffers, memory_order_acquire);
+       buffer; buffer = buffer->next)
+    atomic_store_explicit(
+        &buffer->written,
+        atomic_load_explicit(&buffer->head, memory_order_acquire),
+        memory_order_release);
+
+  express_recorder.start_ns = express_now_ns();
+  atomic_store_explicit(&express_recorder.on, 1, memory_order_release);
+  express_record_unlock();
+  return 0;
 }
 
-/* =============== Express ================== */
+size_t express_record_stop(void) {
+  express_record_lock();
+  FILE *out = express_recorder.out;
+  if (!out) {
+    express_record_unlock();
+    return 0;
+  }
+  atomic_store_explicit(&express_recorder.on, 0, memory_order_relaxed);
+  uint64_t duration = express_now_ns() - express_recorder.start_ns;
 
-Express express_create() {
-  Express app = {0};
+  for (ExpressRecordBuffer *buffer = atomic_load_explicit(
+           &express_recorder.buffers, memory_order_acquire);
+       buffer; buffer = buffer->next)
+    express_record_write(buffer);
 
-  if (pthread_mutex_init(&app.lock, NULL) != 0) {
-    fprintf(stderr, "Failed to initialize lock\n");
-    exit(1);
+  for (uint32_t i = 0; i < express_recorder.count; i++) {
+    ExpressCallback cb = express_recorder.callbacks[i];
+    ExpressRecordCallback callback = {.address = (uintptr_t)cb};
+    Dl_info info;
+    if (dladdr((void *)cb, &info) && info.dli_sname)
+      snprintf(callback.name, sizeof(callback.name), "%s", info.dli_sname);
+    fwrite(&callback, sizeof(callback), 1, out);
   }
 
-  return app;
+  ExpressRecordHeader header = {
+      .magic = EXPRESS_RECORD_MAGIC,
+      .version = EXPRESS_RECORD_VERSION,
+      .event_size = sizeof(ExpressRecordEvent),
+      .callbacks = express_recorder.count,
+      .events = express_recorder.events,
+      .duration_ns = duration,
+  };
+  fseek(out, 0, SEEK_SET);
+  fwrite(&header, sizeof(header), 1, out);
+  fclose(out);
+
+  express_recorder.out = NULL;
+  size_t events = express_recorder.events;
+  express_record_unlock();
+  return events;
 }
+#endif /* EXPRESS_RECORD */
 
-void express_destroy(Express *app) {
-  list_clear(&app->chain);
-  pthread_mutex_destroy(&app->lock);
+/* =============== Shared Memory Stats ================== */
+
+#ifdef EXPRESS_SHM_STATS
+
+/**
+ * @brief Formats the segment name of an Express object.
+ *
+ * @param name Buffer receiving the name.
+ * @param size Size of **name**.
+ * @param pid Process of the Express object.
+ * @param id Express object number in the process.
+ */
+static void express_shm_format(char *name, size_t size, int pid,
+                               unsigned id) {
+  snprintf(name, size, EXPRESS_SHM_PREFIX "%d-%u", pid, id);
 }
 
 /**
- * @brief Adds a callback to the Express chain.
+ * @brief Creates and maps the segment of a new Express object.
  *
- * @param app Pointer to Express object.
- * @param cb Pointer to ExpressCallback function.
+ * @return Pointer to the mapped ExpressShmStats, **NULL** on failure.
  *
- * This function will do nothing if **app** or **cb** is **NULL**.
+ * Failing to create the segment is reported but not fatal, the Express
+ * object then just runs without shared counters.
  */
-void express_add(Express *app, ExpressCallback cb) {
-  if (!app || !cb)
+static ExpressShmStats *express_shm_create(void) {
+  static atomic_uint next_id = 0;
+  unsigned id = atomic_fetch_add_explicit(&next_id, 1, memory_order_relaxed);
+  char name[64];
+
+  express_shm_format(name, sizeof(name), (int)getpid(), id);
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) {
+    perror("Failed to create stats segment");
+    return NULL;
+  }
+
+  ExpressShmStats *shm = MAP_FAILED;
+  if (ftruncate(fd, sizeof(ExpressShmStats)) == 0)
+    shm = mmap(NULL, sizeof(ExpressShmStats), PROT_READ | PROT_WRITE,
+               MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (shm == MAP_FAILED) {
+    perror("Failed to map stats segment");
+    shm_unlink(name);
+    return NULL;
+  }
+
+  shm->pid = (int32_t)getpid();
+  shm->id = id;
+  shm->version = EXPRESS_SHM_VERSION;
+  atomic_thread_fence(memory_order_release);
+  shm->magic = EXPRESS_SHM_MAGIC;
+  return shm;
+}
+
+/**
+ * @brief Unmaps and removes the segment of an Express object.
+ *
+ * @param shm Pointer to ExpressShmStats, may be **NULL**.
+ */
+static void express_shm_destroy(ExpressShmStats *shm) {
+  if (!shm)
     return;
-  pthread_mutex_lock(&app->lock);
-  list_push(&app->chain, cb);
-  pthread_mutex_unlock(&app->lock);
+
+  char name[64];
+  express_shm_format(name, sizeof(name), shm->pid, shm->id);
+  munmap(shm, sizeof(ExpressShmStats));
+  shm_unlink(name);
+}
+
+int express_shm_name(const Express *app, char *name, size_t size) {
+  if (!app || !app->shm || !name)
+    return 1;
+
+  express_shm_format(name, size, app->shm->pid, app->shm->id);
+  return 0;
 }
+#endif /* EXPRESS_SHM_STATS */
 
+/* =============== Watchdog ================== */
+
+#ifdef EXPRESS_WATCHDOG
 /**
- * @brief Executes Express chain of callbacks
+ * @brief State of the watchdog thread.
  *
- * @param app Pointer to express object.
+ * ExpressWatchdog::lock protects the list of watches and the hook.
+ */
+static struct ExpressWatchdog {
+  pthread_mutex_t lock;      /**< Protects everything but stop.*/
+  ExpressWatch *watches;     /**< Watches of every Express object.*/
+  ExpressWatchdogHook hook;  /**< Report hook, **NULL** for stderr.*/
+  void *data;                /**< Argument of the hook.*/
+  pthread_t thread;          /**< Watchdog thread.*/
+  int running;               /**< ExpressWatchdog::thread was started.*/
+  uint64_t period_ns;        /**< Interval between two scans.*/
+  atomic_int stop;           /**< Asks the thread to return.*/
+} express_watchdog = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+/**
+ * @brief Allocates the watch of an Express object and links it.
  *
- * Call this function after adding all callbacks to **Express**.
+ * @return Pointer to the new ExpressWatch.
+ */
+static ExpressWatch *express_watch_create(void) {
+  ExpressWatch *watch = aligned_alloc(EXPRESS_CACHE_LINE, sizeof(ExpressWatch));
+  if (!watch) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  *watch = (ExpressWatch){.budget_ns = EXPRESS_WATCHDOG_BUDGET_NS};
+
+  pthread_mutex_lock(&express_watchdog.lock);
+  watch->next = express_watchdog.watches;
+  express_watchdog.watches = watch;
+  pthread_mutex_unlock(&express_watchdog.lock);
+
+  return watch;
+}
+
+/**
+ * @brief Unlinks and frees the watch of an Express object.
  *
- * @see Express
- * @see express_add
+ * @param watch Pointer to ExpressWatch, may be **NULL**.
  */
-void express_execute(Express *app) {
-  if (!app)
+static void express_watch_destroy(ExpressWatch *watch) {
+  if (!watch)
     return;
 
-  pthread_mutex_lock(&app->lock);
+  pthread_mutex_lock(&express_watchdog.lock);
+  ExpressWatch **link = &express_watchdog.watches;
+  while (*link && *link != watch)
+    link = &(*link)->next;
+  if (*link)
+    *link = watch->next;
+  pthread_mutex_unlock(&express_watchdog.lock);
 
+  free(watch);
+}
+
+/**
+ * @brief Default report of a stall.
+ *
+ * @param stall The stalled callback.
+ * @param data Unused.
+ */
+static void express_watchdog_print(const ExpressStall *stall, void *data) {
+  (void)data;
+  if (stall->symbol)
+    fprintf(stderr, "express watchdog: %s", stall->symbol);
+  else
+    fprintf(stderr, "express watchdog: %p", (void *)stall->cb);
+  fprintf(stderr, " running for %llu ms on thread %d (budget %llu ms)\n",
+          (unsigned long long)(stall->elapsed_ns / 1000000), (int)stall->tid,
+          (unsigned long long)(stall->budget_ns / 1000000));
+}
+
+/**
+ * @brief Looks at every watch once and reports new stalls.
+ *
+ * Called with ExpressWatchdog::lock held.
+ */
+static void express_watchdog_scan(void) {
+  uint64_t now = express_now_ns();
+
+  for (ExpressWatch *w = express_watchdog.watches; w; w = w->next) {
+    uint64_t current = atomic_load_explicit(&w->current, memory_order_relaxed);
+    uint64_t budget = atomic_load_explicit(&w->budget_ns, memory_order_relaxed);
+
+    if (!current || current != w->seen) {
+      w->seen = current;
+      w->since_ns = now;
+      w->reported = 0;
+      continue;
+    }
+    if (!budget || w->reported || now - w->since_ns < budget)
+      continue;
+
+    ExpressStall stall = {
+        .cb = (ExpressCallback)(uintptr_t)(current & ((1ull << 48) - 1)),
+        .tid = atomic_load_explicit(&w->tid, memory_order_relaxed),
+        .elapsed_ns = now - w->since_ns,
+        .budget_ns = budget,
+    };
+    Dl_info info;
+    if (dladdr((void *)stall.cb, &info) && info.dli_sname)
+      stall.symbol = info.dli_sname;
+
+    w->reported = 1;
+    if (express_watchdog.hook)
+      express_watchdog.hook(&stall, express_watchdog.data);
+    else
+      express_watchdog_print(&stall, NULL);
+  }
+}
+
+/**
+ * @brief Body of the watchdog thread.
+ *
+ * @param arg Unused.
+ * @return **NULL**.
+ */
+static void *express_watchdog_run(void *arg) {
+  (void)arg;
+  struct timespec period = {
+      .tv_sec = express_watchdog.period_ns / 1000000000,
+      .tv_nsec = express_watchdog.period_ns % 1000000000,
+  };
+
+  while (!atomic_load_explicit(&express_watchdog.stop, memory_order_relaxed)) {
+    nanosleep(&period, NULL);
+    pthread_mutex_lock(&express_watchdog.lock);
+    express_watchdog_scan();
+    pthread_mutex_unlock(&express_watchdog.lock);
+  }
+
+  return NULL;
+}
+
+int express_watchdog_start(uint64_t period_ns) {
+  int error = 0;
+
+  pthread_mutex_lock(&express_watchdog.lock);
+  if (!express_watchdog.running) {
+    express_watchdog.period_ns =
+        period_ns ? period_ns : EXPRESS_WATCHDOG_PERIOD_NS;
+    atomic_store(&express_watchdog.stop, 0);
+    error = pthread_create(&express_watchdog.thread, NULL,
+                           express_watchdog_run, NULL);
+    express_watchdog.running = !error;
+  }
+  pthread_mutex_unlock(&express_watchdog.lock);
+
+  return error;
+}
+
+void express_watchdog_stop(void) {
+  pthread_mutex_lock(&express_watchdog.lock);
+  int running = express_watchdog.running;
+  pthread_t thread = express_watchdog.thread;
+  express_watchdog.running = 0;
+  atomic_store(&express_watchdog.stop, 1);
+  pthread_mutex_unlock(&express_watchdog.lock);
+
+  if (running)
+    pthread_join(thread, NULL);
+}
+
+void express_watchdog_set_hook(ExpressWatchdogHook hook, void *data) {
+  pthread_mutex_lock(&express_watchdog.lock);
+  express_watchdog.hook = hook;
+  express_watchdog.data = data;
+  pthread_mutex_unlock(&express_watchdog.lock);
+}
+
+void express_watchdog_set_budget(Express *app, uint64_t budget_ns) {
+  if (!app)
+    return;
+  atomic_store_explicit(&app->watch->budget_ns, budget_ns,
+                        memory_order_relaxed);
+}
+#endif /* EXPRESS_WATCHDOG */
+
+/* =============== Lock ================== */
+
+#ifdef EXPRESS_LOCK_STATS
+static const char *express_lock_site_names[E_LOCK_SITES] = {
+    "express_add", "express_add_many", "express_execute", "combine", "query",
+};
+
+ExpressLockStats express_lock_stats(Express *app) {
+  ExpressLockStats stats = {0};
+  if (!app)
+    return stats;
+
+  express_lock(app, E_LOCK_QUERY);
+  ExpressLockProfile *profile = app->lock_profile;
+  double scale = express_clock_scale(&profile->clock);
+
+  for (size_t i = 0; i < E_LOCK_SITES; i++) {
+    ExpressLockCounters *counters = &profile->sites[i];
+    ExpressLockSiteStats *site = &stats.sites[i];
+
+    site->acquisitions = counters->acquisitions;
+    site->contended = counters->contended;
+    site->wait_ns = (uint64_t)(counters->wait * scale);
+    site->max_wait_ns = (uint64_t)(counters->max_wait * scale);
+    site->hold = histogram_latency(&counters->hold, scale);
+  }
+  express_unlock(app);
+
+  return stats;
+}
+
+/**
+ * @brief Prints the Express::lock statistics of every call site.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * Sites that never took the lock are skipped.
+ */
+void express_lock_report(Express *app, FILE *out) {
+  if (!app || !out)
+    return;
+
+  ExpressLockStats stats = express_lock_stats(app);
+
+  fprintf(out, "%-16s %10s %10s %12s %12s %10s %10s %10s\n", "site",
+          "acquired", "contended", "wait ns", "max wait ns", "hold p50",
+          "hold p99", "hold max");
+  for (size_t i = 0; i < E_LOCK_SITES; i++) {
+    ExpressLockSiteStats *site = &stats.sites[i];
+    if (!site->acquisitions)
+      continue;
+
+    fprintf(out, "%-16s %10llu %10llu %12llu %12llu %10llu %10llu %10llu\n",
+            express_lock_site_names[i],
+            (unsigned long long)site->acquisitions,
+            (unsigned long long)site->contended,
+            (unsigned long long)site->wait_ns,
+            (unsigned long long)site->max_wait_ns,
+            (unsigned long long)site->hold.p50,
+            (unsigned long long)site->hold.p99,
+            (unsigned long long)site->hold.max);
+  }
+}
+#endif /* EXPRESS_LOCK_STATS */
+
+/* =============== Express ================== */
+
+Express express_create() {
+  Express app = {0};
+
+#ifndef EXPRESS_SINGLE_THREADED
+  if (pthread_mutex_init(&app.lock, NULL) != 0) {
+    fprintf(stderr, "Failed to initialize lock\n");
+    exit(1);
+  }
+#endif
+#ifdef EXPRESS_PROFILE
+  app.profile = express_profile_create();
+#endif
+#ifdef EXPRESS_LOCK_STATS
+  app.lock_profile = calloc(1, sizeof(ExpressLockProfile));
+  if (!app.lock_profile) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  app.lock_profile->clock = express_clock_start();
+#endif
+#ifdef EXPRESS_SHM_STATS
+  app.shm = express_shm_create();
+#endif
+#ifdef EXPRESS_QUEUE_WAIT
+  app.queue_wait = calloc(1, sizeof(ExpressQueueWait));
+  if (!app.queue_wait) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  app.queue_wait->clock = express_clock_start();
+#endif
+#ifdef EXPRESS_WATCHDOG
+  app.watch = express_watch_create();
+#endif
+#ifdef EXPRESS_RECORD
+  app.record_id = express_record_id();
+#endif
+#ifdef EXPRESS_INSTRUMENTED
+  app.sample_every = EXPRESS_SAMPLE_EVERY;
+  app.sample_countdown = 1;
+#endif
+#ifdef EXPRESS_MEM_STATS
+  app.created_ns = express_now_ns();
+  uint_fast64_t unset = 0;
+  atomic_compare_exchange_strong_explicit(&express_mem_global.start_ns, &unset,
+                                          app.created_ns, memory_order_relaxed,
+                                          memory_order_relaxed);
+#endif
+
+  return app;
+}
+
+void express_destroy(Express *app) {
+  list_clear(&app->chain);
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_destroy(&app->lock);
+#endif
+#ifdef EXPRESS_PROFILE
+  express_profile_free(app->profile);
+  app->profile = NULL;
+#endif
+#ifdef EXPRESS_LOCK_STATS
+  free(app->lock_profile);
+  app->lock_profile = NULL;
+#endif
+#ifdef EXPRESS_SHM_STATS
+  express_shm_destroy(app->shm);
+  app->shm = NULL;
+#endif
+#ifdef EXPRESS_QUEUE_WAIT
+  free(app->queue_wait);
+  app->queue_wait = NULL;
+#endif
+#ifdef EXPRESS_WATCHDOG
+  express_watch_destroy(app->watch);
+  app->watch = NULL;
+#endif
+}
+
+#ifdef EXPRESS_INSTRUMENTED
+/**
+ * @brief Runs one callback of the chain.
+ *
+ * @param app Pointer to the locked Express object.
+ * @param cb Pointer to ExpressCallback function.
+ * @return The ExpressCommand returned by **cb**.
+ *
+ * Wraps the call with the instrumentation enabled at build time, the clock
+ * is read once before and once after the call and shared by all of it.
+ * Performance counters are read outside of the timed window so their
+ * syscalls do not show up in the latencies.
+ */
+static inline ExpressCommand express_invoke(Express *app, ExpressCallback cb) {
+  (void)app;
+  EXPRESS_PROBE(callback__start, app->chain.length, cb);
+#ifdef EXPRESS_PERF_COUNTERS
+  ExpressPerfRead before, after;
+  int counting = express_perf_read(&before);
+#endif
+#if defined(EXPRESS_HISTOGRAMS) || defined(EXPRESS_TRACE)
+  uint64_t start = express_ticks();
+#endif
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_BEGIN, cb, 0, start);
+#endif
+
+  ExpressCommand cmd = cb();
+
+#if defined(EXPRESS_HISTOGRAMS) || defined(EXPRESS_TRACE)
+  uint64_t end = express_ticks();
+#endif
+#ifdef EXPRESS_HISTOGRAMS
+  express_profile_record(app->profile, cb, end - start);
+#endif
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_END, cb, cmd, end);
+#endif
+#ifdef EXPRESS_PERF_COUNTERS
+  if (counting && express_perf_read(&after))
+    express_perf_record(app->profile, cb, &before, &after);
+#endif
+  EXPRESS_PROBE(callback__done, cmd, cb);
+  return cmd;
+}
+
+ExpressCommand express_drain_sampled(Express *app) {
   ExpressCallback cb = NULL;
   ExpressCommand cmd = E_CONTINUE;
 
-  while (cmd == E_CONTINUE) {
-    cb = list_shift(&app->chain);
-    if (cb)
-      cmd = cb();
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_EXECUTE_BEGIN, NULL, 0, express_ticks());
+#endif
+  uint64_t calls = express_watch_begin(app);
+
+  while (cmd == E_CONTINUE && (cb = express_shift(app))) {
+    express_watch(app, cb, ++calls);
+    cmd = express_invoke(app, cb);
+  }
+  express_watch_end(app, calls);
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_EXECUTE_END, NULL, cmd, express_ticks());
+#endif
+
+  return cmd;
+}
+
+void express_set_sample_rate(Express *app, uint32_t every) {
+  if (!app)
+    return;
+
+  express_lock(app, E_LOCK_QUERY);
+  app->sample_every = every;
+  app->sample_countdown = 1;
+  express_unlock(app);
+}
+#endif /* EXPRESS_INSTRUMENTED */
+
+#ifdef EXPRESS_HISTOGRAMS
+ExpressLatency express_latency(Express *app, ExpressCallback cb) {
+  ExpressLatency latency = {0};
+  if (!app || !cb)
+    return latency;
+
+  express_lock(app, E_LOCK_QUERY);
+  ExpressCallbackStats *stats = express_profile_find(app->profile, cb, 0);
+  if (stats)
+    latency = histogram_latency(&stats->latency,
+                                express_clock_scale(&app->profile->clock));
+  express_unlock(app);
+
+  return latency;
+}
+
+/**
+ * @brief Prints the run time distribution of every callback.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * One line per callback, with its address and its percentiles in
+ * nanoseconds.
+ */
+void express_latency_report(Express *app, FILE *out) {
+  if (!app || !out)
+    return;
+
+  express_lock(app, E_LOCK_QUERY);
+  double scale = express_clock_scale(&app->profile->clock);
+
+  fprintf(out, "%-18s %10s %10s %10s %10s %10s\n", "callback", "count",
+          "p50 ns", "p99 ns", "p999 ns", "max ns");
+  for (size_t i = 0; i < EXPRESS_PROFILE_CALLBACKS; i++) {
+    ExpressCallbackStats *stats = app->profile->callbacks[i];
+    if (!stats)
+      continue;
+
+    ExpressLatency latency = histogram_latency(&stats->latency, scale);
+    fprintf(out, "%-18p %10llu %10llu %10llu %10llu %10llu\n",
+            (void *)stats->cb, (unsigned long long)latency.count,
+            (unsigned long long)latency.p50, (unsigned long long)latency.p99,
+            (unsigned long long)latency.p999, (unsigned long long)latency.max);
+  }
+  if (app->profile->dropped)
+    fprintf(out, "%llu runs not recorded, profile table is full\n",
+            (unsigned long long)app->profile->dropped);
+
+  express_unlock(app);
+}
+#endif /* EXPRESS_HISTOGRAMS */
+
+#ifdef EXPRESS_PERF_COUNTERS
+ExpressPerfCounters express_perf_counters(Express *app, ExpressCallback cb) {
+  ExpressPerfCounters counters = {0};
+  if (!app || !cb)
+    return counters;
+
+  express_lock(app, E_LOCK_QUERY);
+  ExpressCallbackStats *stats = express_profile_find(app->profile, cb, 0);
+  if (stats)
+    counters = stats->perf;
+  express_unlock(app);
+
+  counters.software = express_perf_is_software();
+  return counters;
+}
+
+/**
+ * @brief Prints the average event counts per run of every callback.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * The header names the events actually counted, hardware or software.
+ */
+void express_perf_report(Express *app, FILE *out) {
+  if (!app || !out)
+    return;
+
+  express_lock(app, E_LOCK_QUERY);
+  int type = atomic_load_explicit(&express_perf_type, memory_order_acquire);
+  const char **names = express_perf_names[express_perf_is_software()];
+
+  if (type == -1)
+    fprintf(out, "perf_event_open is not available, no counters\n");
+  else
+    fprintf(out, "%-18s %10s %12s %12s %12s %12s\n", "callback", "runs",
+            names[0], names[1], names[2], names[3]);
+
+  for (size_t i = 0; type != -1 && i < EXPRESS_PROFILE_CALLBACKS; i++) {
+    ExpressCallbackStats *stats = app->profile->callbacks[i];
+    if (!stats || !stats->perf.runs)
+      continue;
+
+    double runs = (double)stats->perf.runs;
+    fprintf(out, "%-18p %10llu %12.1f %12.1f %12.1f %12.1f\n",
+            (void *)stats->cb, (unsigned long long)stats->perf.runs,
+            stats->perf.values[0] / runs, stats->perf.values[1] / runs,
+            stats->perf.values[2] / runs, stats->perf.values[3] / runs);
+  }
+
+  express_unlock(app);
+}
+#endif /* EXPRESS_PERF_COUNTERS */
+
+#ifndef EXPRESS_SINGLE_THREADED
+
+/* =============== Sharded Express ================== */
+
+/**
+ * @brief Returns a small index that is unique to the calling thread.
+ *
+ * Indexes are handed out in the order threads first ask for one, so they
+ * spread evenly over the shards.
+ */
+static size_t express_thread_index(void) {
+  static atomic_size_t next = 0;
+  static _Thread_local size_t index = SIZE_MAX;
+
+  if (index == SIZE_MAX)
+    index = atomic_fetch_add_explicit(&next, 1, memory_order_relaxed);
+  return index;
+}
+
+ExpressSharded express_sharded_create(size_t count) {
+  ExpressSharded app = {0};
+
+  if (!count)
+    count = 1;
+
+  app.shards = aligned_alloc(EXPRESS_CACHE_LINE, count * sizeof(ExpressShard));
+  if (!app.shards) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
   }
 
-  pthread_mutex_unlock(&app->lock);
+  for (size_t i = 0; i < count; i++)
+    app.shards[i].app = express_create();
+  app.count = count;
+
+  return app;
+}
+
+void express_sharded_destroy(ExpressSharded *app) {
+  for (size_t i = 0; i < app->count; i++)
+    express_destroy(&app->shards[i].app);
+  free(app->shards);
+  app->shards = NULL;
+  app->count = 0;
+}
+
+/**
+ * @brief Adds a callback to the shard of the calling thread.
+ *
+ * @param app Pointer to ExpressSharded object.
+ * @param cb Pointer to ExpressCallback function.
+ *
+ * A thread always lands on the same shard, so its callbacks keep their order.
+ */
+void express_sharded_add(ExpressSharded *app, ExpressCallback cb) {
+  if (!app)
+    return;
+  express_sharded_add_key(app, express_thread_index(), cb);
+}
+
+void express_sharded_add_key(ExpressSharded *app, size_t key,
+                             ExpressCallback cb) {
+  if (!app || !app->count)
+    return;
+  express_add(&app->shards[key % app->count].app, cb);
+}
+
+/**
+ * @brief Drains the shards round-robin.
+ *
+ * @param app Pointer to ExpressSharded object.
+ *
+ * Every call starts from the shard after the one the previous call started
+ * from, so concurrent consumers begin on different shards and only meet on
+ * a shard lock once one of them has finished its own.
+ *
+ * Draining stops at the first callback that returns E_TRIGGER, the
+ * remaining shards are left for the next call.
+ */
+ExpressCommand express_sharded_execute(ExpressSharded *app) {
+  if (!app || !app->count)
+    return E_CONTINUE;
+
+  size_t start =
+      atomic_fetch_add_explicit(&app->cursor, 1, memory_order_relaxed);
+
+  for (size_t i = 0; i < app->count; i++) {
+    Express *shard = &app->shards[(start + i) % app->count].app;
+    if (express_execute(shard) == E_TRIGGER)
+      return E_TRIGGER;
+  }
+
+  return E_CONTINUE;
+}
+
+/* =============== Per-CPU Express ================== */
+
+ExpressPerCpu express_percpu_create() {
+  ExpressPerCpu app = {0};
+  long cpus = sysconf(_SC_NPROCESSORS_CONF);
+
+  app.count = cpus > 0 ? (size_t)cpus : 1;
+  app.buffers =
+      aligned_alloc(EXPRESS_CACHE_LINE, app.count * sizeof(ExpressCpuBuffer));
+  if (!app.buffers) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < app.count; i++) {
+    if (pthread_mutex_init(&app.buffers[i].lock, NULL) != 0) {
+      fprintf(stderr, "Failed to initialize lock\n");
+      exit(1);
+    }
+    app.buffers[i].count = 0;
+  }
+
+  app.app = express_create();
+  return app;
+}
+
+void express_percpu_destroy(ExpressPerCpu *app) {
+  for (size_t i = 0; i < app->count; i++)
+    pthread_mutex_destroy(&app->buffers[i].lock);
+  free(app->buffers);
+  app->buffers = NULL;
+  app->count = 0;
+  express_destroy(&app->app);
+}
+
+/**
+ * @brief Moves the staged callbacks of one buffer into the chain.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ * @param buffer Pointer to a locked ExpressCpuBuffer of **app**.
+ */
+static void express_percpu_flush_buffer(ExpressPerCpu *app,
+                                        ExpressCpuBuffer *buffer) {
+  express_add_many(&app->app, buffer->cbs, buffer->count);
+  buffer->count = 0;
+}
+
+/**
+ * @brief Stages a callback in the buffer of the current CPU.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ * @param cb Pointer to ExpressCallback function.
+ *
+ * Falls back to the thread index if `sched_getcpu()` is not supported.
+ * The buffer is flushed into the chain once it is full.
+ */
+void express_percpu_add(ExpressPerCpu *app, ExpressCallback cb) {
+  if (!app || !cb || !app->count)
+    return;
+
+  int cpu = sched_getcpu();
+  size_t index = cpu >= 0 ? (size_t)cpu : express_thread_index();
+  ExpressCpuBuffer *buffer = &app->buffers[index % app->count];
+
+  pthread_mutex_lock(&buffer->lock);
+  buffer->cbs[buffer->count++] = cb;
+  if (buffer->count == EXPRESS_CPU_BUFFER_SIZE)
+    express_percpu_flush_buffer(app, buffer);
+  pthread_mutex_unlock(&buffer->lock);
+}
+
+void express_percpu_flush(ExpressPerCpu *app) {
+  if (!app)
+    return;
+
+  for (size_t i = 0; i < app->count; i++) {
+    ExpressCpuBuffer *buffer = &app->buffers[i];
+    pthread_mutex_lock(&buffer->lock);
+    express_percpu_flush_buffer(app, buffer);
+    pthread_mutex_unlock(&buffer->lock);
+  }
+}
+
+ExpressCommand express_percpu_execute(ExpressPerCpu *app) {
+  if (!app)
+    return E_CONTINUE;
+
+  express_percpu_flush(app);
+  return express_execute(&app->app);
+}
+
+/* =============== Flat Combining Express ================== */
+
+/**
+ * @brief Tells the CPU that the caller is spinning.
+ */
+static inline void express_cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+ExpressCombining express_combining_create() {
+  ExpressCombining app = {0};
+
+  app.slots = aligned_alloc(EXPRESS_CACHE_LINE, EXPRESS_COMBINING_SLOTS *
+                                                    sizeof(ExpressCombiningSlot));
+  if (!app.slots) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  for (size_t i = 0; i < EXPRESS_COMBINING_SLOTS; i++)
+    atomic_init(&app.slots[i].request, NULL);
+  atomic_init(&app.used, 0);
+
+  app.app = express_create();
+  return app;
+}
+
+void express_combining_destroy(ExpressCombining *app) {
+  free(app->slots);
+  app->slots = NULL;
+  express_destroy(&app->app);
+}
+
+/**
+ * @brief Becomes the combiner if Express::lock is free.
+ *
+ * @param app Pointer to ExpressCombining object.
+ * @return Zero if the pending requests were applied, non zero if another
+ * thread holds the lock.
+ *
+ * Enqueues the request of every slot like express_add does, then clears the
+ * slot to release its owner.
+ */
+static int express_combining_try(ExpressCombining *app) {
+  if (express_trylock(&app->app, E_LOCK_COMBINE))
+    return 1;
+
+  size_t used = atomic_load_explicit(&app->used, memory_order_acquire);
+  for (size_t i = 0; i < used; i++) {
+    ExpressCombiningSlot *slot = &app->slots[i];
+    ExpressCallback cb =
+        atomic_load_explicit(&slot->request, memory_order_acquire);
+    if (!cb)
+      continue;
+    express_enqueue(&app->app, cb);
+    atomic_store_explicit(&slot->request, NULL, memory_order_release);
+  }
+
+  express_unlock(&app->app);
+  return 0;
+}
+
+/**
+ * @brief Waits for the combiner after a failed attempt to become it.
+ *
+ * @param spins Number of failed attempts so far.
+ *
+ * Spins for a while, then yields so a preempted combiner can finish.
+ */
+static void express_combining_wait(unsigned *spins) {
+  if (++*spins < 64) {
+    express_cpu_relax();
+  } else {
+    *spins = 0;
+    sched_yield();
+  }
+}
+
+/**
+ * @brief Adds a callback to the chain through the combiner.
+ *
+ * @param app Pointer to ExpressCombining object.
+ * @param cb Pointer to ExpressCallback function.
+ *
+ * If the slot is still used by another thread, the caller helps combining
+ * until it is free. Then it waits for its own request to be applied, by
+ * itself or by whichever thread holds the lock.
+ */
+void express_combining_add(ExpressCombining *app, ExpressCallback cb) {
+  if (!app || !cb)
+    return;
+
+  size_t index = express_thread_index() % EXPRESS_COMBINING_SLOTS;
+  ExpressCombiningSlot *slot = &app->slots[index];
+  ExpressCallback expected = NULL;
+  unsigned spins = 0;
+
+  size_t used = atomic_load_explicit(&app->used, memory_order_relaxed);
+  while (used <= index &&
+         !atomic_compare_exchange_weak_explicit(&app->used, &used, index + 1,
+                                                memory_order_release,
+                                                memory_order_relaxed))
+    ;
+
+  while (!atomic_compare_exchange_weak_explicit(&slot->request, &expected, cb,
+                                                memory_order_release,
+                                                memory_order_relaxed)) {
+    expected = NULL;
+    if (express_combining_try(app))
+      express_combining_wait(&spins);
+  }
+
+  while (atomic_load_explicit(&slot->request, memory_order_acquire)) {
+    if (express_combining_try(app))
+      express_combining_wait(&spins);
+  }
+}
+
+ExpressCommand express_combining_execute(ExpressCombining *app) {
+  if (!app)
+    return E_CONTINUE;
+  return express_execute(&app->app);
+}
+
+#endif /* EXPRESS_SINGLE_THREADED */
+
+/* =============== Memory Stats ================== */
+
+#ifdef EXPRESS_MEM_STATS
+ExpressMemGlobal express_mem_global;
+
+/**
+ * @brief Returns allocations per second.
+ *
+ * @param allocations Number of allocations.
+ * @param since Monotonic time the count started at.
+ */
+static double express_mem_rate(uint64_t allocations, uint64_t since) {
+  uint64_t elapsed = express_now_ns() - since;
+  return elapsed ? (double)allocations * 1e9 / (double)elapsed : 0.0;
+}
+
+ExpressMemStats express_mem_stats(Express *app) {
+  ExpressMemStats stats = {0};
+  if (!app)
+    return stats;
+
+  express_lock(app, E_LOCK_QUERY);
+  stats.live_nodes = app->chain.mem.nodes;
+  stats.live_bytes = app->chain.mem.bytes;
+  stats.peak_nodes = app->chain.mem.peak_nodes;
+  stats.allocations = app->chain.mem.allocations;
+  stats.frees = app->chain.mem.frees;
+  express_unlock(app);
+
+  stats.rate = express_mem_rate(stats.allocations, app->created_ns);
+  return stats;
+}
+
+ExpressMemStats express_mem_stats_global(void) {
+  ExpressMemStats stats = {0};
+
+  stats.live_nodes =
+      atomic_load_explicit(&express_mem_global.nodes, memory_order_relaxed);
+  stats.live_bytes =
+      atomic_load_explicit(&express_mem_global.bytes, memory_order_relaxed);
+  stats.peak_nodes = atomic_load_explicit(&express_mem_global.peak_nodes,
+                                          memory_order_relaxed);
+  stats.allocations = atomic_load_explicit(&express_mem_global.allocations,
+                                           memory_order_relaxed);
+  stats.frees =
+      atomic_load_explicit(&express_mem_global.frees, memory_order_relaxed);
+
+  uint64_t start =
+      atomic_load_explicit(&express_mem_global.start_ns, memory_order_relaxed);
+  if (start)
+    stats.rate = express_mem_rate(stats.allocations, start);
+  return stats;
+}
+
+/**
+ * @brief Prints one line of memory accounting.
+ *
+ * @param out Stream to print to.
+ * @param name Label of the line.
+ * @param stats Pointer to the accounting to print.
+ */
+static void express_mem_print(FILE *out, const char *name,
+                              const ExpressMemStats *stats) {
+  fprintf(out, "%-8s %12llu %12llu %12llu %12llu %12llu %14.0f\n", name,
+          (unsigned long long)stats->live_nodes,
+          (unsigned long long)stats->live_bytes,
+          (unsigned long long)stats->peak_nodes,
+          (unsigned long long)stats->allocations,
+          (unsigned long long)stats->frees, stats->rate);
+}
+
+void express_mem_report(Express *app, FILE *out) {
+  if (!out)
+    return;
+
+  fprintf(out, "%-8s %12s %12s %12s %12s %12s %14s\n", "scope", "live nodes",
+          "live bytes", "peak nodes", "allocs", "frees", "allocs/sec");
+  if (app) {
+    ExpressMemStats stats = express_mem_stats(app);
+    express_mem_print(out, "express", &stats);
+  }
+
+  ExpressMemStats global = express_mem_stats_global();
+  express_mem_print(out, "global", &global);
+}
+#endif /* EXPRESS_MEM_STATS */
+
+/* =============== Queue Wait ================== */
+
+#ifdef EXPRESS_QUEUE_WAIT
+ExpressLatency express_queue_wait(Express *app) {
+  ExpressLatency latency = {0};
+  if (!app)
+    return latency;
+
+  express_lock(app, E_LOCK_QUERY);
+  latency = histogram_latency(&app->queue_wait->wait,
+                              express_clock_scale(&app->queue_wait->clock));
+  express_unlock(app);
+
+  return latency;
 }
+#endif /* EXPRESS_QUEUE_WAIT */
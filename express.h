@@ -0,0 +1,2620 @@
+/**
+ * @file express.h
+ * @brief Simple Express chain, types and inline hot path.
+ *
+ * Build options:
+ * - `EXPRESS_SINGLE_THREADED` compiles out Express::lock and all the locking,
+ *   together with the ExpressSharded, ExpressPerCpu and ExpressCombining
+ *   variants. The binary does not need `-lpthread`, but an Express object
+ *   must then only be used by one thread.
+ * - `EXPRESS_HISTOGRAMS` times every callback run by `express_execute` and
+ *   records it into a latency Histogram per callback, see express_latency.
+ * - `EXPRESS_LOCK_STATS` records acquisitions, contention, wait time and hold
+ *   time of Express::lock per call site, see express_lock_stats.
+ * - `EXPRESS_TRACE` records every add and callback run into per-thread ring
+ *   buffers that `express_trace_dump` writes as Chrome trace-event JSON. Link
+ *   with `-rdynamic` so callbacks of the executable resolve to their names.
+ * - `EXPRESS_NO_PROBES` removes the static tracepoints, see EXPRESS_PROBE.
+ * - `EXPRESS_SHM_STATS` publishes the counters of every Express object in a
+ *   shared memory segment (see express_shm.h) that `express-top` reads.
+ * - `EXPRESS_PERF_COUNTERS` counts cycles, instructions, branch misses and
+ *   cache misses of every callback with `perf_event_open`, falling back to
+ *   software events without a hardware PMU, see express_perf_counters.
+ * - `EXPRESS_MEM_STATS` accounts every allocation and free of chain storage,
+ *   per Express object and for the whole process, see express_mem_stats.
+ * - `EXPRESS_QUEUE_WAIT` stamps every Node when it is queued and records how
+ *   long it waited when it is dequeued, see express_queue_wait.
+ * - `EXPRESS_WATCHDOG` lets a background thread report callbacks that run
+ *   longer than the budget of their chain, see express_watchdog_start.
+ * - `EXPRESS_DISPATCH` picks how `express_execute` calls the callbacks, see
+ *   EXPRESS_DISPATCH_LIST and EXPRESS_CALLBACKS.
+ * - `EXPRESS_RECORD` logs every add and execute with its time and thread to
+ *   a binary file (see express_record.h) that `bench/replay` plays back, see
+ *   express_record_start.
+ *
+ * With any of EXPRESS_HISTOGRAMS, EXPRESS_TRACE or EXPRESS_PERF_COUNTERS,
+ * only 1 in EXPRESS_SAMPLE_EVERY executions is instrumented, the rate can be
+ * changed at run time with express_set_sample_rate.
+ *
+ * express_add, express_add_many, express_execute and the List functions they
+ * use are `static inline` in this header so they are compiled into the
+ * caller. The rest lives in `libexpress.a` or `libexpress.so`, built from
+ * express.c. Include this header before any system header, and build the
+ * code that includes it with the same options and EXPRESS_CALLBACKS as the
+ * library: they change the layout of Express and Node. A mismatch of the
+ * options fails to link, see EXPRESS_ABI.
+ */
+
+#ifndef EXPRESS_H
+#define EXPRESS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <sched.h>
+#ifndef EXPRESS_SINGLE_THREADED
+#include <pthread.h>
+#endif
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef EXPRESS_SHM_STATS
+#include "express_shm.h"
+#endif
+#ifdef EXPRESS_RECORD
+#include "express_record.h"
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @def EXPRESS_CACHE_LINE
+ * @brief Cache line size used to pad objects that are written by different
+ * threads.
+ */
+#ifndef EXPRESS_CACHE_LINE
+#define EXPRESS_CACHE_LINE 64
+#endif
+
+/**
+ * @def EXPRESS_CPU_BUFFER_SIZE
+ * @brief Number of callbacks a per-CPU staging buffer holds before it is
+ * flushed into the chain.
+ */
+#ifndef EXPRESS_CPU_BUFFER_SIZE
+#define EXPRESS_CPU_BUFFER_SIZE 64
+#endif
+
+/**
+ * @def EXPRESS_COMBINING_SLOTS
+ * @brief Number of publication slots of an ExpressCombining object.
+ *
+ * Threads share a slot when there are more threads than slots.
+ */
+#ifndef EXPRESS_COMBINING_SLOTS
+#define EXPRESS_COMBINING_SLOTS 64
+#endif
+
+/**
+ * @def EXPRESS_PROFILE_CALLBACKS
+ * @brief Number of distinct callbacks an Express object keeps statistics for,
+ * must be a power of two.
+ */
+#ifndef EXPRESS_PROFILE_CALLBACKS
+#define EXPRESS_PROFILE_CALLBACKS 256
+#endif
+
+/**
+ * @def EXPRESS_TRACE_EVENTS
+ * @brief Number of events in the trace ring buffer of each thread, must be a
+ * power of two. Older events are overwritten.
+ */
+#ifndef EXPRESS_TRACE_EVENTS
+#define EXPRESS_TRACE_EVENTS (1u << 16)
+#endif
+
+/**
+ * @def EXPRESS_RECORD_EVENTS
+ * @brief Number of events each thread buffers before writing them to the
+ * recording, must be a power of two.
+ */
+#ifndef EXPRESS_RECORD_EVENTS
+#define EXPRESS_RECORD_EVENTS (1u << 12)
+#endif
+
+/**
+ * @def EXPRESS_PROBE
+ * @brief Static tracepoint (USDT) with two 64 bits arguments.
+ *
+ * @param name Probe name, `__` shows up as `-` in the tools.
+ * @param arg1 First argument.
+ * @param arg2 Second argument.
+ *
+ * Emits a single `nop` in the code and describes it in the `.note.stapsdt`
+ * ELF section the same way `<sys/sdt.h>` does, without depending on
+ * systemtap. Tools such as `perf`, `bpftrace` and `bcc` replace the `nop`
+ * with a breakpoint when they attach:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.sh}
+ * bpftrace -e 'usdt:./express:express:add { @depth = hist(arg0); }'
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Probes of the `express` provider:
+ * - `add(depth, cb)` after express_add queued **cb**.
+ * - `shift(depth, value)` after list_shift removed **value**.
+ * - `callback__start(depth, cb)` right before **cb** runs.
+ * - `callback__done(cmd, cb)` right after **cb** returned **cmd**.
+ *
+ * Only x86_64 and aarch64 ELF targets have probes, elsewhere and with
+ * EXPRESS_NO_PROBES the macro expands to nothing.
+ */
+#if !defined(EXPRESS_NO_PROBES) && defined(__ELF__) &&                         \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define EXPRESS_PROBE(name, arg1, arg2)                                        \
+  __asm__ __volatile__(                                                        \
+      "990: nop\n"                                                             \
+      ".pushsection .note.stapsdt,\"?\",\"note\"\n"                             \
+      ".balign 4\n"                                                            \
+      ".4byte 992f-991f, 994f-993f, 3\n"                                       \
+      "991: .asciz \"stapsdt\"\n"                                              \
+      "992: .balign 4\n"                                                       \
+      "993: .8byte 990b\n"                                                     \
+      ".8byte _.stapsdt.base\n"                                                \
+      ".8byte 0\n"                                                             \
+      ".asciz \"express\"\n"                                                   \
+      ".asciz \"" #name "\"\n"                                                 \
+      ".asciz \"8@%[a1] 8@%[a2]\"\n"                                           \
+      "994: .balign 4\n"                                                       \
+      ".popsection\n"                                                          \
+      ".ifndef _.stapsdt.base\n"                                               \
+      ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"  \
+      ".weak _.stapsdt.base\n"                                                 \
+      ".hidden _.stapsdt.base\n"                                               \
+      "_.stapsdt.base: .space 1\n"                                             \
+      ".size _.stapsdt.base, 1\n"                                              \
+      ".popsection\n"                                                          \
+      ".endif\n"                                                               \
+      :                                                                        \
+      : [a1] "nor"((uint64_t)(uintptr_t)(arg1)),                               \
+        [a2] "nor"((uint64_t)(uintptr_t)(arg2)))
+#else
+#define EXPRESS_PROBE(name, arg1, arg2) ((void)0)
+#endif
+
+/**
+ * @def EXPRESS_PERF_EVENTS
+ * @brief Number of counters of an ExpressPerfCounters group.
+ */
+#define EXPRESS_PERF_EVENTS 4
+
+/* Per callback statistics are kept as soon as one of them is enabled. */
+#if defined(EXPRESS_HISTOGRAMS) || defined(EXPRESS_PERF_COUNTERS)
+#define EXPRESS_PROFILE
+#endif
+
+/* Executions are sampled as soon as callbacks are instrumented. */
+#if defined(EXPRESS_PROFILE) || defined(EXPRESS_TRACE)
+#define EXPRESS_INSTRUMENTED
+#endif
+
+/**
+ * @def EXPRESS_SAMPLE_EVERY
+ * @brief Default number of `express_execute` calls per instrumented one.
+ *
+ * One instruments every execution, zero none of them.
+ */
+#ifndef EXPRESS_SAMPLE_EVERY
+#define EXPRESS_SAMPLE_EVERY 1
+#endif
+
+#if defined(EXPRESS_LOCK_STATS) && defined(EXPRESS_SINGLE_THREADED)
+#error "EXPRESS_LOCK_STATS needs Express::lock, drop EXPRESS_SINGLE_THREADED"
+#endif
+
+#if defined(EXPRESS_WATCHDOG) && defined(EXPRESS_SINGLE_THREADED)
+#error "EXPRESS_WATCHDOG needs a thread, drop EXPRESS_SINGLE_THREADED"
+#endif
+
+/**
+ * @def EXPRESS_WATCHDOG_BUDGET_NS
+ * @brief Default time a callback may run before the watchdog reports it.
+ *
+ * @def EXPRESS_WATCHDOG_PERIOD_NS
+ * @brief Default interval between two scans of the watchdog.
+ */
+#ifndef EXPRESS_WATCHDOG_BUDGET_NS
+#define EXPRESS_WATCHDOG_BUDGET_NS 100000000ull
+#endif
+#ifndef EXPRESS_WATCHDOG_PERIOD_NS
+#define EXPRESS_WATCHDOG_PERIOD_NS 10000000ull
+#endif
+
+/**
+ * @def EXPRESS_DISPATCH_LIST
+ * @brief Dispatch engine that shifts one callback off the chain and calls it
+ * through its pointer. The default.
+ *
+ * @def EXPRESS_DISPATCH_ARRAY
+ * @brief Dispatch engine that calls the callbacks stored in a NodeBlock, see
+ * express_build_from_array, by index over the block and frees the block
+ * once. Other callbacks are shifted and called like EXPRESS_DISPATCH_LIST.
+ *
+ * @def EXPRESS_DISPATCH_SWITCH
+ * @brief Dispatch engine that tags every Node with the ID of its callback in
+ * EXPRESS_CALLBACKS when it is queued, and calls the registered callbacks
+ * directly from a `switch` on that ID.
+ *
+ * @def EXPRESS_DISPATCH_GOTO
+ * @brief Same tags as EXPRESS_DISPATCH_SWITCH, but every registered callback
+ * has its own computed `goto` to the next one (threaded code), which gives
+ * the branch predictor one indirect jump per callback instead of a shared
+ * one. Needs GCC or Clang.
+ *
+ * @def EXPRESS_DISPATCH
+ * @brief Engine that runs the executions that are not instrumented.
+ *
+ * EXPRESS_DISPATCH_LIST is the default: the array engine only differs on
+ * chains built with express_build_from_array, and the switch and goto
+ * engines need EXPRESS_CALLBACKS to be the same in every translation unit.
+ */
+#define EXPRESS_DISPATCH_LIST 0
+#define EXPRESS_DISPATCH_ARRAY 1
+#define EXPRESS_DISPATCH_SWITCH 2
+#define EXPRESS_DISPATCH_GOTO 3
+
+#ifndef EXPRESS_DISPATCH
+#define EXPRESS_DISPATCH EXPRESS_DISPATCH_LIST
+#endif
+
+/* Nodes carry a callback ID for the engines that switch on it. */
+#if EXPRESS_DISPATCH == EXPRESS_DISPATCH_SWITCH ||                             \
+    EXPRESS_DISPATCH == EXPRESS_DISPATCH_GOTO
+#define EXPRESS_TAGGED
+#endif
+
+#if EXPRESS_DISPATCH == EXPRESS_DISPATCH_GOTO && !defined(__GNUC__)
+#error "EXPRESS_DISPATCH_GOTO needs labels as values, use GCC or Clang"
+#endif
+
+/**
+ * @def EXPRESS_CALLBACKS
+ * @brief X-macro of the callbacks that EXPRESS_DISPATCH_SWITCH and
+ * EXPRESS_DISPATCH_GOTO call directly, `X(name)` for each of them.
+ *
+ * Registered callbacks must have external linkage, they are declared here.
+ * Define the list before including express.h:
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.c}
+ * #define EXPRESS_CALLBACKS(X) X(parse_callback) X(reply_callback)
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * Other callbacks are still called through their pointer. By default no
+ * callback is registered. Every file that adds to or executes the same
+ * Express object must see the same list, the variants are filled and run
+ * inside the library so they only call directly the callbacks registered
+ * when the library was built.
+ */
+#ifndef EXPRESS_CALLBACKS
+#define EXPRESS_CALLBACKS(X)
+#endif
+
+/**
+ * @def EXPRESS_ABI
+ * @brief Symbol defined by the library and named after the build options
+ * that change the layout of Express, List and Node or the inline hot path,
+ * for example `express_abi_lock_mem_d0`.
+ *
+ * Every file that includes this header refers to it, so code built with
+ * other options than the library fails to link instead of corrupting
+ * memory. The sizes (EXPRESS_CACHE_LINE, EXPRESS_TRACE_EVENTS...) and
+ * EXPRESS_CALLBACKS are not part of it, they must still match.
+ */
+#ifdef EXPRESS_SINGLE_THREADED
+#define EXPRESS_ABI_ST _st
+#else
+#define EXPRESS_ABI_ST
+#endif
+#ifdef EXPRESS_HISTOGRAMS
+#define EXPRESS_ABI_HISTOGRAMS _hist
+#else
+#define EXPRESS_ABI_HISTOGRAMS
+#endif
+#ifdef EXPRESS_LOCK_STATS
+#define EXPRESS_ABI_LOCK_STATS _lock
+#else
+#define EXPRESS_ABI_LOCK_STATS
+#endif
+#ifdef EXPRESS_TRACE
+#define EXPRESS_ABI_TRACE _trace
+#else
+#define EXPRESS_ABI_TRACE
+#endif
+#ifdef EXPRESS_SHM_STATS
+#define EXPRESS_ABI_SHM_STATS _shm
+#else
+#define EXPRESS_ABI_SHM_STATS
+#endif
+#ifdef EXPRESS_PERF_COUNTERS
+#define EXPRESS_ABI_PERF_COUNTERS _perf
+#else
+#define EXPRESS_ABI_PERF_COUNTERS
+#endif
+#ifdef EXPRESS_MEM_STATS
+#define EXPRESS_ABI_MEM_STATS _mem
+#else
+#define EXPRESS_ABI_MEM_STATS
+#endif
+#ifdef EXPRESS_QUEUE_WAIT
+#define EXPRESS_ABI_QUEUE_WAIT _wait
+#else
+#define EXPRESS_ABI_QUEUE_WAIT
+#endif
+#ifdef EXPRESS_WATCHDOG
+#define EXPRESS_ABI_WATCHDOG _watchdog
+#else
+#define EXPRESS_ABI_WATCHDOG
+#endif
+#ifdef EXPRESS_RECORD
+#define EXPRESS_ABI_RECORD _record
+#else
+#define EXPRESS_ABI_RECORD
+#endif
+
+#define EXPRESS_ABI_NAME(st, hist, lock, trace, shm, perf, mem, wait, dog,      \
+                         record, dispatch)                                     \
+  express_abi##st##hist##lock##trace##shm##perf##mem##wait##dog##record##_d##  \
+      dispatch
+#define EXPRESS_ABI_EXPAND(...) EXPRESS_ABI_NAME(__VA_ARGS__)
+#define EXPRESS_ABI                                                            \
+  EXPRESS_ABI_EXPAND(EXPRESS_ABI_ST, EXPRESS_ABI_HISTOGRAMS,                   \
+                     EXPRESS_ABI_LOCK_STATS, EXPRESS_ABI_TRACE,                \
+                     EXPRESS_ABI_SHM_STATS, EXPRESS_ABI_PERF_COUNTERS,         \
+                     EXPRESS_ABI_MEM_STATS, EXPRESS_ABI_QUEUE_WAIT,            \
+                     EXPRESS_ABI_WATCHDOG, EXPRESS_ABI_RECORD,                 \
+                     EXPRESS_DISPATCH)
+
+extern const char EXPRESS_ABI;
+static const char *const express_abi_check __attribute__((used)) =
+    &EXPRESS_ABI;
+
+/**
+ * @def HISTOGRAM_SUB_BITS
+ * @brief Each power of two range of a Histogram is split in
+ * `2^HISTOGRAM_SUB_BITS` linear buckets, which bounds the relative error to
+ * about 3%.
+ *
+ * @def HISTOGRAM_MAX_BITS
+ * @brief Values from `2^HISTOGRAM_MAX_BITS` up are counted in the last
+ * bucket.
+ *
+ * @def HISTOGRAM_BUCKETS
+ * @brief Number of buckets of a Histogram.
+ */
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_MAX_BITS 40
+#define HISTOGRAM_BUCKETS                                                      \
+  ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+/**
+ * @typedef Node
+ * @brief Represents a linked list node.
+ * @see Node
+ *
+ * @struct Node
+ * @brief Represents doubly linked list node.
+ * @see node_create
+ *
+ * Use create_node function to allocate one.
+ *
+ * To free just call the **stdlib** `free()` function.
+ */
+typedef struct Node {
+  void *value;       /**< Pointer to the linked list node value */
+  struct Node *next; /**< Pointer to the linked list next node */
+  struct Node *prev; /**< Pointer to the linked list previous node */
+#ifdef EXPRESS_QUEUE_WAIT
+  uint64_t enqueued; /**< Clock ticks when the node was pushed */
+#endif
+#ifdef EXPRESS_TAGGED
+  unsigned id; /**< ID of the callback in EXPRESS_CALLBACKS, 0 if none */
+#endif
+} Node;
+
+/**
+ * @typedef NodeBlock
+ * @brief Nodes of a chain made by a single allocation.
+ * @see express_build_from_array
+ *
+ * @struct NodeBlock
+ * @brief Header of an allocation holding NodeBlock::count nodes.
+ * @see node_block_create
+ *
+ * The nodes of a block are never freed one by one, the whole block is freed
+ * when its last node leaves the List.
+ */
+typedef struct NodeBlock {
+  struct NodeBlock *next; /**< Next block of the list, in chain order */
+  size_t count;           /**< Number of nodes in the block */
+  Node nodes[];           /**< The nodes, linked in array order */
+} NodeBlock;
+
+/**
+ * @typedef ListMemStats
+ * @brief Storage accounting of one List.
+ * @see List
+ *
+ * Only part of List when built with EXPRESS_MEM_STATS.
+ */
+typedef struct ListMemStats {
+  uint64_t allocations; /**< Number of allocations made for the list.*/
+  uint64_t frees;       /**< Number of allocations given back.*/
+  uint64_t bytes;       /**< Bytes currently allocated for the list.*/
+  uint64_t nodes;       /**< Nodes currently allocated for the list.*/
+  uint64_t peak_nodes;  /**< Largest ListMemStats::nodes seen.*/
+} ListMemStats;
+
+/**
+ * @typedef ExpressMemStats
+ * @brief Chain storage accounting report.
+ * @see express_mem_stats
+ * @see express_mem_stats_global
+ */
+typedef struct ExpressMemStats {
+  uint64_t live_nodes;  /**< Nodes currently allocated.*/
+  uint64_t live_bytes;  /**< Bytes currently allocated.*/
+  uint64_t peak_nodes;  /**< Largest number of nodes allocated at once.*/
+  uint64_t allocations; /**< Number of allocations so far.*/
+  uint64_t frees;       /**< Number of frees so far.*/
+  double rate;          /**< Allocations per second since the start.*/
+} ExpressMemStats;
+
+/**
+ * @typedef List
+ * @brief Represents a doubly linked list.
+ * @see List
+ *
+ * @struct List
+ * @brief Represents a doubly linked list data structure.
+ * @see list_push
+ * @see list_shift
+ * @see list_clear
+ *
+ * You don't have to allocate it.
+ *
+ * But don't forget to call `list_clear(*List)` to free any remaining nodes,
+ * as nodes created in *heap*.
+ */
+typedef struct List {
+  Node *head;        /**< First node of the list */
+  Node *tail;        /**< Last node of the list */
+  size_t length;     /**< Number of nodes in the list */
+  NodeBlock *blocks; /**< Blocks holding nodes of the list, in chain order */
+#ifdef EXPRESS_MEM_STATS
+  ListMemStats mem; /**< Storage accounting of the list */
+#endif
+} List;
+
+/**
+ * @typedef ExpressCommand
+ * @brief Represents command for the Express chain execute function.
+ *
+ * @enum ExpressCommand
+ * @brief Represents command for the Express chain execute function.
+ * @see ExpressCallback
+ * @see express_execute
+ */
+typedef enum ExpressCommand {
+  E_CONTINUE, /**< Continue chain execution */
+  E_TRIGGER,  /**< Trigger stop action */
+} ExpressCommand;
+
+/**
+ * @typedef ExpressClock
+ * @brief Reference point used to convert clock ticks to nanoseconds.
+ * @see express_clock_start
+ * @see express_clock_scale
+ */
+typedef struct ExpressClock {
+  uint64_t ticks; /**< Clock ticks at the reference point.*/
+  uint64_t ns;    /**< Monotonic time at the reference point.*/
+} ExpressClock;
+
+/**
+ * @typedef Histogram
+ * @brief Log-linear histogram of 64 bits values.
+ * @see Histogram
+ *
+ * @struct Histogram
+ * @brief Log-linear (HDR style) histogram of 64 bits values.
+ * @see histogram_record
+ * @see histogram_percentile
+ * @see histogram_latency
+ *
+ * Values below `2^(HISTOGRAM_SUB_BITS + 1)` are exact, larger ones land in
+ * one of the `2^HISTOGRAM_SUB_BITS` buckets of their power of two range.
+ * Recording is a few shifts and one increment, there is no allocation.
+ *
+ * Zero initialize it before use.
+ */
+typedef struct Histogram {
+  uint64_t count;                      /**< Number of recorded values.*/
+  uint64_t max;                        /**< Largest recorded value.*/
+  uint64_t buckets[HISTOGRAM_BUCKETS]; /**< Counts per bucket.*/
+} Histogram;
+
+/**
+ * @typedef ExpressLatency
+ * @brief Summary of a latency Histogram, in nanoseconds.
+ * @see histogram_latency
+ * @see express_latency
+ */
+typedef struct ExpressLatency {
+  uint64_t count; /**< Number of recorded values.*/
+  uint64_t p50;   /**< Median.*/
+  uint64_t p99;   /**< 99th percentile.*/
+  uint64_t p999;  /**< 99.9th percentile.*/
+  uint64_t max;   /**< Largest recorded value.*/
+} ExpressLatency;
+
+/**
+ * @typedef ExpressLockSite
+ * @brief Call sites that take Express::lock.
+ * @see ExpressLockStats
+ */
+typedef enum ExpressLockSite {
+  E_LOCK_ADD,      /**< express_add */
+  E_LOCK_ADD_MANY, /**< express_add_many and express_build_from_array */
+  E_LOCK_EXECUTE,  /**< express_execute */
+  E_LOCK_COMBINE,  /**< Flat combining pass */
+  E_LOCK_QUERY,    /**< Statistics queries */
+  E_LOCK_SITES,    /**< Number of call sites */
+} ExpressLockSite;
+
+/**
+ * @typedef ExpressLockSiteStats
+ * @brief Lock statistics of one call site.
+ * @see ExpressLockStats
+ */
+typedef struct ExpressLockSiteStats {
+  uint64_t acquisitions; /**< Number of times the lock was taken.*/
+  uint64_t contended;    /**< Acquisitions that had to wait.*/
+  uint64_t wait_ns;      /**< Total time spent waiting for the lock.*/
+  uint64_t max_wait_ns;  /**< Longest wait for the lock.*/
+  ExpressLatency hold;   /**< Distribution of the time the lock was held.*/
+} ExpressLockSiteStats;
+
+/**
+ * @typedef ExpressLockStats
+ * @brief Snapshot of the Express::lock statistics.
+ * @see express_lock_stats
+ */
+typedef struct ExpressLockStats {
+  ExpressLockSiteStats sites[E_LOCK_SITES]; /**< Indexed by ExpressLockSite.*/
+} ExpressLockStats;
+
+/**
+ * @typedef Express
+ * @brief Object that stores chain of callbacks and executes them one after the
+ * other.
+ * @see Express
+ *
+ * @struct Express
+ * @brief Object that stores chain of callbacks and executes them one after the
+ * other.
+ *
+ * @see List
+ * @see express_create
+ * @see express_add
+ * @see express_destroy
+ *
+ * You don't have to allocate this object in heap.
+ * Just create it by using `Express express_create()` function.
+ *
+ * Don't forget to call `express_destory(*Express)`, this function just make
+ * sure that no linked list nodes remain in the heap.
+ *
+ * This object is **thread safe**, unless built with EXPRESS_SINGLE_THREADED.
+ */
+typedef struct Express {
+  List chain; /**< Linked list object that stores all the callback functions.*/
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_t lock; /**< Muxtex Lock for thread safety.*/
+#endif
+#ifdef EXPRESS_PROFILE
+  struct ExpressProfile *profile; /**< Per callback statistics.*/
+#endif
+#ifdef EXPRESS_LOCK_STATS
+  struct ExpressLockProfile *lock_profile; /**< Express::lock statistics.*/
+#endif
+#ifdef EXPRESS_SHM_STATS
+  struct ExpressShmStats *shm; /**< Shared memory counters, may be **NULL**.*/
+#endif
+#ifdef EXPRESS_MEM_STATS
+  uint64_t created_ns; /**< Monotonic time the object was created at.*/
+#endif
+#ifdef EXPRESS_QUEUE_WAIT
+  struct ExpressQueueWait *queue_wait; /**< Time spent in the chain.*/
+#endif
+#ifdef EXPRESS_WATCHDOG
+  struct ExpressWatch *watch; /**< What the executor is running.*/
+#endif
+#ifdef EXPRESS_RECORD
+  uint16_t record_id; /**< Number of the object in recordings.*/
+#endif
+#ifdef EXPRESS_INSTRUMENTED
+  uint32_t sample_every;     /**< Executions per instrumented one.*/
+  uint32_t sample_countdown; /**< Executions left before the next sample.*/
+#endif
+} Express;
+
+/**
+ * @typedef ExpressCallback
+ * @brief A callback that passed to *express_add*.
+ * @param ExpressCommand Pointer to ExpressCallback function.
+ * @see express_add
+ * @see ExpressCommand
+ *
+ * @return ExpressCommand that tells the Express chain executer what to do next.
+ */
+typedef ExpressCommand (*ExpressCallback)(void);
+
+#ifdef EXPRESS_TAGGED
+#define EXPRESS_CALLBACK_DECLARE(name) ExpressCommand name(void);
+#define EXPRESS_CALLBACK_ID(name) E_CALLBACK_##name,
+EXPRESS_CALLBACKS(EXPRESS_CALLBACK_DECLARE)
+
+/**
+ * @brief IDs of the callbacks of EXPRESS_CALLBACKS.
+ * @see Node::id
+ */
+enum ExpressCallbackId {
+  E_CALLBACK_NONE, /**< Callback that is not registered */
+  EXPRESS_CALLBACKS(EXPRESS_CALLBACK_ID)
+};
+#endif /* EXPRESS_TAGGED */
+
+/**
+ * @typedef ExpressPerfCounters
+ * @brief Hardware (or software) event counts of a callback.
+ * @see express_perf_counters
+ *
+ * With a hardware PMU the counters are cycles, instructions, branch misses
+ * and cache misses. Without one, ExpressPerfCounters::software is set and
+ * they are task clock nanoseconds, context switches, page faults and CPU
+ * migrations. Only user space is counted.
+ */
+typedef struct ExpressPerfCounters {
+  uint64_t runs;     /**< Number of counted runs.*/
+  int software;      /**< Non zero if the counters are software events.*/
+  uint64_t values[EXPRESS_PERF_EVENTS]; /**< Sum over all the runs.*/
+} ExpressPerfCounters;
+
+#ifdef EXPRESS_PROFILE
+/**
+ * @typedef ExpressCallbackStats
+ * @brief Statistics of one callback.
+ * @see ExpressProfile
+ */
+typedef struct ExpressCallbackStats {
+  ExpressCallback cb; /**< The callback.*/
+#ifdef EXPRESS_HISTOGRAMS
+  Histogram latency; /**< Run time of the callback, in clock ticks.*/
+#endif
+#ifdef EXPRESS_PERF_COUNTERS
+  ExpressPerfCounters perf; /**< Event counts of the callback.*/
+#endif
+} ExpressCallbackStats;
+
+/**
+ * @typedef ExpressProfile
+ * @brief Per callback statistics of an Express object.
+ * @see ExpressProfile
+ *
+ * @struct ExpressProfile
+ * @brief Open addressing table of ExpressCallbackStats keyed by callback.
+ * @see express_latency
+ * @see express_latency_report
+ *
+ * Only built with EXPRESS_HISTOGRAMS or EXPRESS_PERF_COUNTERS. It is updated
+ * by `express_execute` while Express::lock is held.
+ *
+ * Latencies are recorded in ticks of the cheapest clock available (the TSC
+ * on x86) and converted to nanoseconds when they are queried, using the
+ * ticks and nanoseconds elapsed since the profile was created.
+ */
+typedef struct ExpressProfile {
+  ExpressClock clock; /**< Clock reference taken when it was created.*/
+  uint64_t dropped;   /**< Runs not recorded because the table is full.*/
+  /** Table of heap allocated statistics, **NULL** for a free entry.*/
+  ExpressCallbackStats *callbacks[EXPRESS_PROFILE_CALLBACKS];
+} ExpressProfile;
+#endif /* EXPRESS_PROFILE */
+
+#ifdef EXPRESS_QUEUE_WAIT
+/**
+ * @typedef ExpressQueueWait
+ * @brief Distribution of the time callbacks spend in the chain.
+ * @see express_queue_wait
+ *
+ * Only built with EXPRESS_QUEUE_WAIT. Updated at dequeue while Express::lock
+ * is held.
+ */
+typedef struct ExpressQueueWait {
+  ExpressClock clock; /**< Clock reference taken when it was created.*/
+  Histogram wait;     /**< Ticks between push and shift.*/
+} ExpressQueueWait;
+#endif /* EXPRESS_QUEUE_WAIT */
+
+#ifdef EXPRESS_WATCHDOG
+/**
+ * @typedef ExpressWatch
+ * @brief Callback an Express object is running, as seen by the watchdog.
+ * @see express_watchdog_start
+ *
+ * The executor publishes each callback with a single relaxed store of
+ * ExpressWatch::current, which packs the callback address (low 48 bits) with
+ * a running call number (high 16 bits) so that two runs of the same callback
+ * in a row are told apart. The watchdog timestamps a value when it first
+ * sees it and reports it once it has stayed longer than the budget.
+ *
+ * Watches are allocated with the Express object and linked in a list that
+ * the watchdog thread scans.
+ */
+typedef struct ExpressWatch {
+  _Alignas(EXPRESS_CACHE_LINE) _Atomic uint64_t current; /**< Call or 0.*/
+  _Atomic pid_t tid;           /**< Thread of the last execution.*/
+  uint64_t calls;              /**< Call number, written by the executor.*/
+  _Atomic uint64_t budget_ns;  /**< Zero disables the reports.*/
+  _Alignas(EXPRESS_CACHE_LINE) uint64_t seen; /**< Last current seen.*/
+  uint64_t since_ns;           /**< When ExpressWatch::seen was first seen.*/
+  int reported;                /**< ExpressWatch::seen was reported.*/
+  struct ExpressWatch *next;   /**< Next watch of the watchdog list.*/
+} ExpressWatch;
+
+/**
+ * @typedef ExpressStall
+ * @brief A callback that ran past the budget of its chain.
+ * @see ExpressWatchdogHook
+ */
+typedef struct ExpressStall {
+  ExpressCallback cb; /**< Callback still running.*/
+  const char *symbol; /**< Name of **cb**, **NULL** if unknown.*/
+  pid_t tid;          /**< Thread running **cb**.*/
+  uint64_t elapsed_ns; /**< Time it has been seen running for.*/
+  uint64_t budget_ns;  /**< Budget of the chain.*/
+} ExpressStall;
+
+/**
+ * @typedef ExpressWatchdogHook
+ * @brief Called by the watchdog thread for every stalled callback.
+ * @see express_watchdog_set_hook
+ *
+ * @param stall The stalled callback.
+ * @param data Pointer given to `express_watchdog_set_hook`.
+ */
+typedef void (*ExpressWatchdogHook)(const ExpressStall *stall, void *data);
+#endif /* EXPRESS_WATCHDOG */
+
+#ifdef EXPRESS_LOCK_STATS
+/**
+ * @typedef ExpressLockCounters
+ * @brief Live lock statistics of one call site, in clock ticks.
+ * @see ExpressLockProfile
+ */
+typedef struct ExpressLockCounters {
+  uint64_t acquisitions; /**< Number of times the lock was taken.*/
+  uint64_t contended;    /**< Acquisitions that had to wait.*/
+  uint64_t wait;         /**< Total ticks spent waiting for the lock.*/
+  uint64_t max_wait;     /**< Longest wait for the lock.*/
+  Histogram hold;        /**< Ticks the lock was held.*/
+} ExpressLockCounters;
+
+/**
+ * @typedef ExpressLockProfile
+ * @brief Live statistics of Express::lock.
+ * @see ExpressLockProfile
+ *
+ * @struct ExpressLockProfile
+ * @brief Live statistics of Express::lock.
+ * @see express_lock_stats
+ * @see express_lock_report
+ *
+ * Only built with EXPRESS_LOCK_STATS. Every field is written by the lock
+ * owner, so no atomics are needed.
+ */
+typedef struct ExpressLockProfile {
+  ExpressClock clock;         /**< Clock reference taken when it was created.*/
+  ExpressLockSite site;       /**< Call site of the current owner.*/
+  uint64_t held_since;        /**< Ticks when the current owner got the lock.*/
+  ExpressLockCounters sites[E_LOCK_SITES]; /**< Indexed by ExpressLockSite.*/
+} ExpressLockProfile;
+#endif /* EXPRESS_LOCK_STATS */
+
+#ifdef EXPRESS_TRACE
+/**
+ * @typedef ExpressTraceType
+ * @brief Kind of a trace event.
+ * @see ExpressTraceEvent
+ */
+typedef enum ExpressTraceType {
+  E_TRACE_ADD,           /**< Callback added by express_add */
+  E_TRACE_ADD_MANY,      /**< express_add_many or express_build_from_array */
+  E_TRACE_EXECUTE_BEGIN, /**< express_execute got the lock */
+  E_TRACE_EXECUTE_END,   /**< express_execute is about to unlock */
+  E_TRACE_BEGIN,         /**< Callback starts running */
+  E_TRACE_END,           /**< Callback returned */
+} ExpressTraceType;
+
+/**
+ * @typedef ExpressTraceEvent
+ * @brief One entry of an ExpressTraceRing.
+ */
+typedef struct ExpressTraceEvent {
+  uint64_t ticks;        /**< Clock ticks of the event.*/
+  ExpressCallback cb;    /**< Callback of the event, may be **NULL**.*/
+  ExpressTraceType type; /**< Kind of the event.*/
+  uint32_t arg;          /**< Callback count or returned ExpressCommand.*/
+} ExpressTraceEvent;
+
+/**
+ * @typedef ExpressTraceRing
+ * @brief Trace events of one thread.
+ * @see ExpressTraceRing
+ *
+ * @struct ExpressTraceRing
+ * @brief Single producer ring buffer of trace events.
+ * @see express_trace_dump
+ *
+ * Only built with EXPRESS_TRACE. Each thread takes a ring on its first event,
+ * so recording never takes a lock. Rings are linked to a global list and
+ * never freed: when a thread exits its ring is released, its events can
+ * still be dumped until a new thread takes the ring over. There are never
+ * more rings than threads alive at once.
+ */
+typedef struct ExpressTraceRing {
+  struct ExpressTraceRing *next; /**< Next ring of the global list.*/
+  atomic_int owned;              /**< A live thread writes to the ring.*/
+  pid_t tid;                     /**< Thread that owns the ring.*/
+  ExpressClock clock;            /**< Clock reference of the ring.*/
+  atomic_uint_fast64_t first;    /**< First event of the current owner.*/
+  atomic_uint_fast64_t head;     /**< Number of events ever written.*/
+  ExpressTraceEvent events[EXPRESS_TRACE_EVENTS]; /**< The ring.*/
+} ExpressTraceRing;
+#endif /* EXPRESS_TRACE */
+
+#ifdef EXPRESS_RECORD
+/**
+ * @typedef ExpressRecordBuffer
+ * @brief Recorded events of one thread.
+ * @see ExpressRecordBuffer
+ *
+ * @struct ExpressRecordBuffer
+ * @brief Single producer ring of events waiting to be written.
+ * @see express_record_start
+ *
+ * Only built with EXPRESS_RECORD. The thread that owns the buffer writes
+ * its events once it is full, express_record_stop writes what is left in
+ * the buffers of every thread. Callbacks are kept as pointers until they
+ * are written, they only get their number in the recording then.
+ *
+ * Buffers are never freed, the buffer of an exited thread is taken over by
+ * the next new thread. Its pending events keep the tid of their thread.
+ */
+typedef struct ExpressRecordBuffer {
+  struct ExpressRecordBuffer *next; /**< Next buffer of the global list.*/
+  atomic_int owned;                 /**< A live thread writes to the buffer.*/
+  uint32_t tid;                     /**< Thread that owns the buffer.*/
+  atomic_uint_fast64_t head;        /**< Number of events ever buffered.*/
+  atomic_uint_fast64_t written;     /**< Number of events ever written.*/
+  ExpressCallback cbs[EXPRESS_RECORD_EVENTS]; /**< Callback of each event.*/
+  ExpressRecordEvent events[EXPRESS_RECORD_EVENTS]; /**< The ring.*/
+} ExpressRecordBuffer;
+#endif /* EXPRESS_RECORD */
+
+#ifndef EXPRESS_SINGLE_THREADED
+/**
+ * @typedef ExpressShard
+ * @brief One sub-chain of an ExpressSharded object.
+ * @see ExpressShard
+ *
+ * @struct ExpressShard
+ * @brief Express object padded to its own cache line.
+ * @see ExpressSharded
+ *
+ * Every shard owns its chain and its lock, so producers that land on
+ * different shards never touch the same cache line.
+ */
+typedef struct ExpressShard {
+  _Alignas(EXPRESS_CACHE_LINE) Express app; /**< The shard chain and lock.*/
+} ExpressShard;
+
+/**
+ * @typedef ExpressSharded
+ * @brief Express variant that spreads its chain over N independent shards.
+ * @see ExpressSharded
+ *
+ * @struct ExpressSharded
+ * @brief Express variant that spreads its chain over N independent shards.
+ *
+ * @see ExpressShard
+ * @see express_sharded_create
+ * @see express_sharded_add
+ * @see express_sharded_add_key
+ * @see express_sharded_execute
+ * @see express_sharded_destroy
+ *
+ * Create it with `express_sharded_create(size_t)` and release it with
+ * `express_sharded_destroy(*ExpressSharded)`.
+ *
+ * Producers pick a shard by their thread index (or by a caller supplied key),
+ * so each shard keeps the order of the callbacks added to it, but there is
+ * **no global order** between callbacks of different shards.
+ *
+ * This object is **thread safe**.
+ */
+typedef struct ExpressSharded {
+  ExpressShard *shards; /**< Array of `count` cache line aligned shards.*/
+  size_t count;         /**< Number of shards.*/
+  atomic_size_t cursor; /**< Shard the next consumer starts draining from.*/
+} ExpressSharded;
+
+/**
+ * @typedef ExpressCpuBuffer
+ * @brief Staging buffer of one CPU.
+ * @see ExpressCpuBuffer
+ *
+ * @struct ExpressCpuBuffer
+ * @brief Staging buffer of one CPU, aligned to its own cache line.
+ * @see ExpressPerCpu
+ *
+ * The lock is only shared by the threads running on that CPU, so it is
+ * normally uncontended and its cache line stays local.
+ */
+typedef struct ExpressCpuBuffer {
+  _Alignas(EXPRESS_CACHE_LINE) pthread_mutex_t lock; /**< Buffer lock.*/
+  size_t count; /**< Number of staged callbacks.*/
+  ExpressCallback cbs[EXPRESS_CPU_BUFFER_SIZE]; /**< Staged callbacks.*/
+} ExpressCpuBuffer;
+
+/**
+ * @typedef ExpressPerCpu
+ * @brief Express object with per-CPU enqueue buffers.
+ * @see ExpressPerCpu
+ *
+ * @struct ExpressPerCpu
+ * @brief Express object with per-CPU enqueue buffers.
+ *
+ * @see ExpressCpuBuffer
+ * @see express_percpu_create
+ * @see express_percpu_add
+ * @see express_percpu_flush
+ * @see express_percpu_execute
+ * @see express_percpu_destroy
+ *
+ * Producers append to the buffer of the CPU they run on (`sched_getcpu()`).
+ * A buffer is flushed into the chain when it is full or when a consumer calls
+ * `express_percpu_execute(*ExpressPerCpu)`.
+ *
+ * Ordering model:
+ * - Callbacks added from the same CPU keep their order.
+ * - Callbacks added from different CPUs are ordered by flush, not by the time
+ *   they were added.
+ * - A thread that migrates between CPUs can see its callbacks reordered.
+ *   Use the plain Express object if a thread needs a strict order.
+ * - Every `express_percpu_add` that returned before `express_percpu_execute`
+ *   was called is part of that execution.
+ *
+ * This object is **thread safe**.
+ */
+typedef struct ExpressPerCpu {
+  Express app;               /**< Chain the buffers are flushed into.*/
+  ExpressCpuBuffer *buffers; /**< One buffer per configured CPU.*/
+  size_t count;              /**< Number of buffers.*/
+} ExpressPerCpu;
+
+/**
+ * @typedef ExpressCombiningSlot
+ * @brief Publication slot of an ExpressCombining object.
+ * @see ExpressCombiningSlot
+ *
+ * @struct ExpressCombiningSlot
+ * @brief Publication slot, aligned to its own cache line.
+ * @see ExpressCombining
+ */
+typedef struct ExpressCombiningSlot {
+  /** Pending callback, **NULL** once the combiner applied it.*/
+  _Alignas(EXPRESS_CACHE_LINE) _Atomic(ExpressCallback) request;
+} ExpressCombiningSlot;
+
+/**
+ * @typedef ExpressCombining
+ * @brief Express object whose mutations are applied by flat combining.
+ * @see ExpressCombining
+ *
+ * @struct ExpressCombining
+ * @brief Express object whose mutations are applied by flat combining.
+ *
+ * @see ExpressCombiningSlot
+ * @see express_combining_create
+ * @see express_combining_add
+ * @see express_combining_execute
+ * @see express_combining_destroy
+ *
+ * A producer publishes its callback in the slot of its thread and then tries
+ * to take Express::lock. The thread that gets the lock becomes the combiner
+ * and pushes every pending request in one pass, the others just wait for
+ * their slot to be cleared. So under contention the chain is only touched by
+ * one core at a time, while the lock changes hands once per pass instead of
+ * once per callback.
+ *
+ * Callbacks of the same thread keep their order.
+ *
+ * This object is **thread safe**.
+ */
+typedef struct ExpressCombining {
+  Express app;                 /**< Chain, its lock is the combiner lock.*/
+  ExpressCombiningSlot *slots; /**< EXPRESS_COMBINING_SLOTS slots.*/
+  atomic_size_t used;          /**< Number of slots the combiner scans.*/
+} ExpressCombining;
+#endif /* EXPRESS_SINGLE_THREADED */
+
+/* =============== Function Prototypes ================== */
+
+/**
+ * @brief Creates an empty Express object.
+ *
+ * @return An empty Express object, that is allocated on the stack.
+ */
+Express express_create();
+
+/**
+ * @brief Cleans any heap nodes created for the chain.
+ *
+ * @param app Pointer to Express object.
+ */
+void express_destroy(Express *app);
+
+/**
+ * @brief Moves all the nodes of another list to the end of the list.
+ *
+ * @param list Pointer to List to append to.
+ * @param other Pointer to List to take the nodes from, left empty.
+ * @see List
+ * @see express_add_many
+ *
+ * No node is allocated or freed, the two lists are just linked together,
+ * and so are their NodeBlock lists. With EXPRESS_MEM_STATS the storage
+ * accounting moves along with the nodes.
+ */
+void list_splice(List *list, List *other);
+
+/**
+ * @brief Frees Node objects from heap.
+ *
+ * @param list Pointer to List to clear and free.
+ * @see List
+ * @see Express::chain
+ *
+ * Just freese the Node object, you must handle Node::value on your own.
+ */
+void list_clear(List *list);
+
+/**
+ * @brief Returns a percentile of the recorded values.
+ *
+ * @param histogram Pointer to Histogram.
+ * @param percentile Percentile between 0 and 100.
+ * @return Upper bound of the bucket holding the percentile, never more than
+ * Histogram::max. Zero for an empty histogram.
+ * @see Histogram
+ */
+uint64_t histogram_percentile(const Histogram *histogram, double percentile);
+
+/**
+ * @brief Summarizes a histogram.
+ *
+ * @param histogram Pointer to Histogram.
+ * @param scale Factor applied to every value, for example to convert clock
+ * ticks to nanoseconds.
+ * @return ExpressLatency holding the scaled percentiles.
+ * @see Histogram
+ */
+ExpressLatency histogram_latency(const Histogram *histogram, double scale);
+
+#ifdef EXPRESS_INSTRUMENTED
+/**
+ * @brief Sets how often `express_execute` is instrumented.
+ *
+ * @param app Pointer to Express object.
+ * @param every Instrument 1 in **every** executions, zero disables it.
+ *
+ * Instrumented executions feed the histograms, the trace and the perf
+ * counters, the others only pay for a counter decrement. The next execution
+ * is always instrumented after a change.
+ *
+ * Only built with EXPRESS_HISTOGRAMS, EXPRESS_TRACE or
+ * EXPRESS_PERF_COUNTERS.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_set_sample_rate(Express *app, uint32_t every);
+
+/**
+ * @brief Runs the chain with every callback instrumented.
+ *
+ * @param app Pointer to the locked Express object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if the chain
+ * was drained.
+ */
+ExpressCommand express_drain_sampled(Express *app);
+#endif /* EXPRESS_INSTRUMENTED */
+
+#ifdef EXPRESS_HISTOGRAMS
+/**
+ * @brief Returns the run time distribution of a callback.
+ *
+ * @param app Pointer to Express object.
+ * @param cb Pointer to ExpressCallback function.
+ * @return Latency summary in nanoseconds, all zeros if **cb** never ran.
+ *
+ * Only built with EXPRESS_HISTOGRAMS.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressLatency express_latency(Express *app, ExpressCallback cb);
+
+/**
+ * @brief Prints the run time distribution of every callback.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * Only built with EXPRESS_HISTOGRAMS.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_latency_report(Express *app, FILE *out);
+#endif /* EXPRESS_HISTOGRAMS */
+
+#ifdef EXPRESS_PERF_COUNTERS
+/**
+ * @brief Returns the event counts of a callback.
+ *
+ * @param app Pointer to Express object.
+ * @param cb Pointer to ExpressCallback function.
+ * @return Counters summed over all the counted runs, all zeros if **cb**
+ * never ran or if no counter could be opened.
+ *
+ * Only built with EXPRESS_PERF_COUNTERS.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressPerfCounters express_perf_counters(Express *app, ExpressCallback cb);
+
+/**
+ * @brief Prints the average event counts per run of every callback.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * Only built with EXPRESS_PERF_COUNTERS.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_perf_report(Express *app, FILE *out);
+#endif /* EXPRESS_PERF_COUNTERS */
+
+#ifdef EXPRESS_LOCK_STATS
+/**
+ * @brief Returns a snapshot of the Express::lock statistics.
+ *
+ * @param app Pointer to Express object.
+ * @return Statistics per call site, times in nanoseconds.
+ *
+ * Only built with EXPRESS_LOCK_STATS. The query itself is counted under
+ * E_LOCK_QUERY.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressLockStats express_lock_stats(Express *app);
+
+/**
+ * @brief Prints the Express::lock statistics of every call site.
+ *
+ * @param app Pointer to Express object.
+ * @param out Stream to print to.
+ *
+ * Only built with EXPRESS_LOCK_STATS.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_lock_report(Express *app, FILE *out);
+#endif /* EXPRESS_LOCK_STATS */
+
+#ifdef EXPRESS_TRACE
+/**
+ * @brief Writes the events of every thread as Chrome trace-event JSON.
+ *
+ * @param out Stream to write to.
+ * @return Number of events written.
+ *
+ * Open the output in `chrome://tracing` or https://ui.perfetto.dev.
+ * Callback addresses are resolved to symbol names with `dladdr`.
+ *
+ * Only built with EXPRESS_TRACE.
+ *
+ * This function is *Thread Safe*, events recorded while dumping may be
+ * missing from the output.
+ */
+size_t express_trace_dump(FILE *out);
+
+/**
+ * @brief Appends an event to the ring of the calling thread.
+ *
+ * @param type Kind of the event.
+ * @param cb Callback of the event, may be **NULL**.
+ * @param arg Callback count or returned ExpressCommand.
+ * @param ticks Clock ticks of the event.
+ */
+void express_trace(ExpressTraceType type, ExpressCallback cb, uint32_t arg,
+                   uint64_t ticks);
+#endif /* EXPRESS_TRACE */
+
+#ifdef EXPRESS_RECORD
+/**
+ * @brief Starts recording the adds and executes of every Express object.
+ *
+ * @param path File to write the recording to, truncated.
+ * @return Zero on success, an error number otherwise, `EBUSY` if a
+ * recording is already running.
+ *
+ * Events are buffered per thread and written in chunks, so recording costs a
+ * clock read and a copy per call. Replay the file with `bench/replay`.
+ *
+ * Only built with EXPRESS_RECORD.
+ *
+ * This function is *Thread Safe*.
+ */
+int express_record_start(const char *path);
+
+/**
+ * @brief Writes the buffered events and closes the recording.
+ *
+ * @return Number of events in the recording, zero if none was running.
+ *
+ * Callbacks are resolved to symbol names with `dladdr`, link with
+ * `-rdynamic` so the callbacks of the executable get one. Stop it once the
+ * threads being recorded are done, an event made during the stop can be
+ * lost.
+ *
+ * Only built with EXPRESS_RECORD.
+ *
+ * This function is *Thread Safe*.
+ */
+size_t express_record_stop(void);
+
+/**
+ * @brief Records an add of one callback.
+ *
+ * @param app Pointer to the Express object.
+ * @param cb Pointer to the added ExpressCallback function.
+ */
+void express_record_add(Express *app, ExpressCallback cb);
+
+/**
+ * @brief Records an add of an array of callbacks.
+ *
+ * @param app Pointer to the Express object.
+ * @param cbs Array of ExpressCallback functions, **NULL** entries are left
+ * out like the add does.
+ * @param n Number of callbacks in **cbs**.
+ */
+void express_record_many(Express *app, const ExpressCallback *cbs, size_t n);
+
+/**
+ * @brief Records an execute.
+ *
+ * @param app Pointer to the Express object.
+ * @param start_ns express_now_ns when the execute was called.
+ * @param ran Number of callbacks it ran.
+ * @param cmd ExpressCommand it returned.
+ */
+void express_record_execute(Express *app, uint64_t start_ns, size_t ran,
+                            ExpressCommand cmd);
+#endif /* EXPRESS_RECORD */
+
+#ifdef EXPRESS_QUEUE_WAIT
+/**
+ * @brief Returns the distribution of the time callbacks waited in the chain.
+ *
+ * @param app Pointer to Express object.
+ * @return Summary in nanoseconds of the time between `express_add` and the
+ * moment `express_execute` dequeued the callback.
+ *
+ * Callbacks staged by ExpressPerCpu are stamped when their buffer is
+ * flushed.
+ *
+ * Only built with EXPRESS_QUEUE_WAIT.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressLatency express_queue_wait(Express *app);
+#endif /* EXPRESS_QUEUE_WAIT */
+
+#ifdef EXPRESS_WATCHDOG
+/**
+ * @brief Starts the watchdog thread.
+ *
+ * @param period_ns Interval between two scans, 0 for
+ * EXPRESS_WATCHDOG_PERIOD_NS.
+ * @return Zero on success (or if it already runs), an error number
+ * otherwise.
+ *
+ * The watchdog looks at every Express object each period and reports a
+ * callback that has run for more than the budget of its chain once, through
+ * the hook or to `stderr` when there is none. The elapsed time is measured
+ * from the first scan that saw the callback, so it is short by up to one
+ * period.
+ *
+ * Only built with EXPRESS_WATCHDOG.
+ *
+ * This function is *Thread Safe*.
+ */
+int express_watchdog_start(uint64_t period_ns);
+
+/**
+ * @brief Stops the watchdog thread and waits for it.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_watchdog_stop(void);
+
+/**
+ * @brief Replaces the report of the watchdog with a hook.
+ *
+ * @param hook Function to call for every stall, **NULL** to report to
+ * `stderr`.
+ * @param data Pointer passed to **hook**.
+ *
+ * The hook runs on the watchdog thread while it holds the list of watches,
+ * it must not create or destroy Express objects.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_watchdog_set_hook(ExpressWatchdogHook hook, void *data);
+
+/**
+ * @brief Sets how long a callback of a chain may run.
+ *
+ * @param app Pointer to Express object.
+ * @param budget_ns Budget in nanoseconds, 0 stops watching this chain.
+ *
+ * Chains start with EXPRESS_WATCHDOG_BUDGET_NS.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_watchdog_set_budget(Express *app, uint64_t budget_ns);
+#endif /* EXPRESS_WATCHDOG */
+
+#ifdef EXPRESS_MEM_STATS
+/**
+ * @brief Returns the chain storage accounting of an Express object.
+ *
+ * @param app Pointer to Express object.
+ * @return Live nodes and bytes, peak of live nodes, allocation counts and
+ * the allocation rate since the object was created. Nodes of a NodeBlock
+ * stay live until the whole block is freed.
+ *
+ * Only built with EXPRESS_MEM_STATS.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressMemStats express_mem_stats(Express *app);
+
+/**
+ * @brief Returns the chain storage accounting of the whole process.
+ *
+ * @return Totals over every List, the rate is measured since the first
+ * Express object was created.
+ *
+ * Only built with EXPRESS_MEM_STATS.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressMemStats express_mem_stats_global(void);
+
+/**
+ * @brief Prints the accounting of an Express object and of the process.
+ *
+ * @param app Pointer to Express object, may be **NULL**.
+ * @param out Stream to print to.
+ *
+ * Only built with EXPRESS_MEM_STATS.
+ */
+void express_mem_report(Express *app, FILE *out);
+#endif /* EXPRESS_MEM_STATS */
+
+#ifdef EXPRESS_SHM_STATS
+/**
+ * @brief Returns the name of the shared memory segment of an Express object.
+ *
+ * @param app Pointer to Express object.
+ * @param name Buffer receiving the name, as passed to `shm_open`.
+ * @param size Size of **name**.
+ * @return Zero on success, non zero if the segment could not be created.
+ *
+ * Only built with EXPRESS_SHM_STATS.
+ */
+int express_shm_name(const Express *app, char *name, size_t size);
+#endif /* EXPRESS_SHM_STATS */
+
+#ifndef EXPRESS_SINGLE_THREADED
+/**
+ * @brief Creates a sharded Express object.
+ *
+ * @param count Number of shards, zero is treated as one.
+ * @return ExpressSharded object, its shards are allocated in heap.
+ */
+ExpressSharded express_sharded_create(size_t count);
+
+/**
+ * @brief Adds ExpressCallback to the shard of the calling thread.
+ *
+ * @param app Pointer to ExpressSharded object.
+ * @param cb Pointer to ExpressCallback function to add to the chain.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_sharded_add(ExpressSharded *app, ExpressCallback cb);
+
+/**
+ * @brief Adds ExpressCallback to the shard selected by a key.
+ *
+ * @param app Pointer to ExpressSharded object.
+ * @param key Caller key, callbacks with the same key keep their order.
+ * @param cb Pointer to ExpressCallback function to add to the chain.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_sharded_add_key(ExpressSharded *app, size_t key,
+                             ExpressCallback cb);
+
+/**
+ * @brief Drains the shards round-robin.
+ *
+ * @param app Pointer to ExpressSharded object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if all the
+ * shards were drained.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressCommand express_sharded_execute(ExpressSharded *app);
+
+/**
+ * @brief Cleans the shards and any heap nodes created for them.
+ *
+ * @param app Pointer to ExpressSharded object.
+ */
+void express_sharded_destroy(ExpressSharded *app);
+
+/**
+ * @brief Creates an Express object with one staging buffer per CPU.
+ *
+ * @return ExpressPerCpu object, its buffers are allocated in heap.
+ */
+ExpressPerCpu express_percpu_create();
+
+/**
+ * @brief Stages ExpressCallback in the buffer of the current CPU.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ * @param cb Pointer to ExpressCallback function to add to the chain.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_percpu_add(ExpressPerCpu *app, ExpressCallback cb);
+
+/**
+ * @brief Flushes all the staging buffers into the chain.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_percpu_flush(ExpressPerCpu *app);
+
+/**
+ * @brief Flushes the staging buffers and executes the chain.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if the chain
+ * was drained.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressCommand express_percpu_execute(ExpressPerCpu *app);
+
+/**
+ * @brief Cleans the staging buffers and any heap nodes of the chain.
+ *
+ * @param app Pointer to ExpressPerCpu object.
+ *
+ * Staged callbacks that were never flushed are dropped.
+ */
+void express_percpu_destroy(ExpressPerCpu *app);
+
+/**
+ * @brief Creates a flat combining Express object.
+ *
+ * @return ExpressCombining object, its slots are allocated in heap.
+ */
+ExpressCombining express_combining_create();
+
+/**
+ * @brief Adds ExpressCallback to the chain through the combiner.
+ *
+ * @param app Pointer to ExpressCombining object.
+ * @param cb Pointer to ExpressCallback function to add to the chain.
+ *
+ * Returns once the callback is part of the chain.
+ *
+ * This function is *Thread Safe*.
+ */
+void express_combining_add(ExpressCombining *app, ExpressCallback cb);
+
+/**
+ * @brief Executes the chain.
+ *
+ * @param app Pointer to ExpressCombining object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if the chain
+ * was drained.
+ *
+ * This function is *Thread Safe*.
+ */
+ExpressCommand express_combining_execute(ExpressCombining *app);
+
+/**
+ * @brief Cleans the slots and any heap nodes of the chain.
+ *
+ * @param app Pointer to ExpressCombining object.
+ */
+void express_combining_destroy(ExpressCombining *app);
+#endif /* EXPRESS_SINGLE_THREADED */
+
+/* =============== Clock ================== */
+
+/**
+ * @brief Reads the monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary point in the past.
+ */
+static inline uint64_t express_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Reads the cheapest clock available.
+ *
+ * @return The TSC on x86, the monotonic clock in nanoseconds elsewhere.
+ *
+ * Ticks are only meaningful as differences, convert them with the ratio of
+ * ticks to nanoseconds measured over a long enough interval.
+ */
+static inline uint64_t express_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return express_now_ns();
+#endif
+}
+
+/**
+ * @brief Takes a clock reference point.
+ *
+ * @return ExpressClock holding the current ticks and monotonic time.
+ */
+static inline ExpressClock express_clock_start(void) {
+  ExpressClock clock = {express_ticks(), express_now_ns()};
+  return clock;
+}
+
+/**
+ * @brief Returns the number of nanoseconds per clock tick.
+ *
+ * @param clock Pointer to the reference point.
+ *
+ * Measured between the reference point and now, so it gets more precise the
+ * older the reference point is.
+ */
+static inline double express_clock_scale(const ExpressClock *clock) {
+  uint64_t ticks = express_ticks() - clock->ticks;
+  uint64_t ns = express_now_ns() - clock->ns;
+  return ticks ? (double)ns / (double)ticks : 1.0;
+}
+
+/* =============== Memory Accounting ================== */
+
+#ifdef EXPRESS_MEM_STATS
+/**
+ * @typedef ExpressMemGlobal
+ * @struct ExpressMemGlobal
+ * @brief Process wide chain storage counters.
+ *
+ * Updated with relaxed atomics, List counters are protected by the lock of
+ * their owner instead.
+ */
+typedef struct ExpressMemGlobal {
+  atomic_uint_fast64_t allocations; /**< Number of allocations.*/
+  atomic_uint_fast64_t frees;       /**< Number of frees.*/
+  atomic_uint_fast64_t bytes;       /**< Bytes currently allocated.*/
+  atomic_uint_fast64_t nodes;       /**< Nodes currently allocated.*/
+  atomic_uint_fast64_t peak_nodes;  /**< Largest value of nodes.*/
+  atomic_uint_fast64_t start_ns;    /**< Creation of the first Express.*/
+} ExpressMemGlobal;
+
+extern ExpressMemGlobal express_mem_global;
+#endif /* EXPRESS_MEM_STATS */
+
+/**
+ * @brief Accounts an allocation made for a List.
+ *
+ * @param list Pointer to the List the storage belongs to.
+ * @param nodes Number of nodes the allocation holds.
+ * @param bytes Size of the allocation.
+ *
+ * Does nothing unless built with EXPRESS_MEM_STATS.
+ */
+static inline void list_mem_alloc(List *list, size_t nodes, size_t bytes) {
+#ifdef EXPRESS_MEM_STATS
+  list->mem.allocations++;
+  list->mem.bytes += bytes;
+  list->mem.nodes += nodes;
+  if (list->mem.nodes > list->mem.peak_nodes)
+    list->mem.peak_nodes = list->mem.nodes;
+
+  atomic_fetch_add_explicit(&express_mem_global.allocations, 1,
+                            memory_order_relaxed);
+  atomic_fetch_add_explicit(&express_mem_global.bytes, bytes,
+                            memory_order_relaxed);
+  uint64_t live = atomic_fetch_add_explicit(&express_mem_global.nodes, nodes,
+                                            memory_order_relaxed) +
+                  nodes;
+  uint64_t peak =
+      atomic_load_explicit(&express_mem_global.peak_nodes, memory_order_relaxed);
+  while (live > peak && !atomic_compare_exchange_weak_explicit(
+                            &express_mem_global.peak_nodes, &peak, live,
+                            memory_order_relaxed, memory_order_relaxed))
+    ;
+#else
+  (void)list;
+  (void)nodes;
+  (void)bytes;
+#endif
+}
+
+/**
+ * @brief Accounts storage of a List given back to the allocator.
+ *
+ * @param list Pointer to the List the storage belonged to.
+ * @param frees Number of allocations freed.
+ * @param nodes Number of nodes the allocations held.
+ * @param bytes Total size of the allocations.
+ *
+ * Does nothing unless built with EXPRESS_MEM_STATS.
+ */
+static inline void list_mem_free(List *list, size_t frees, size_t nodes,
+                                 size_t bytes) {
+#ifdef EXPRESS_MEM_STATS
+  list->mem.frees += frees;
+  list->mem.bytes -= bytes;
+  list->mem.nodes -= nodes;
+
+  atomic_fetch_add_explicit(&express_mem_global.frees, frees,
+                            memory_order_relaxed);
+  atomic_fetch_sub_explicit(&express_mem_global.bytes, bytes,
+                            memory_order_relaxed);
+  atomic_fetch_sub_explicit(&express_mem_global.nodes, nodes,
+                            memory_order_relaxed);
+#else
+  (void)list;
+  (void)frees;
+  (void)nodes;
+  (void)bytes;
+#endif
+}
+
+/* =============== Node Type ================== */
+
+/**
+ * @brief Allocates a new Node object in heap.
+ *
+ *
+ * @param value Pointer to the value holded by the node.
+ * @param next Pointer to the next node.
+ * @param prev Pointer to the previous node.
+ * @return Pointer to the heap allocated Node object.
+ * @see Node
+ *
+ * Don't forget to free the Node by calling `free(*Node)`
+ */
+static inline Node *node_create(void *value, Node *next, Node *prev) {
+  Node *node = malloc(sizeof(Node));
+  if (!node) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  node->value = value;
+  node->next = next;
+  node->prev = prev;
+  return node;
+}
+
+/**
+ * @brief Allocates room for several nodes at once.
+ *
+ * @param count Number of nodes in the block.
+ * @return Pointer to the heap allocated NodeBlock, its nodes are not
+ * initialized.
+ * @see NodeBlock
+ */
+static inline NodeBlock *node_block_create(size_t count) {
+  NodeBlock *block = malloc(sizeof(NodeBlock) + count * sizeof(Node));
+  if (!block) {
+    fprintf(stderr, "Failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  block->next = NULL;
+  block->count = count;
+  return block;
+}
+
+/* =============== List Type ================== */
+
+/**
+ * @brief Pushes/Adds a new value to the list
+ *
+ * @param list Pointer to List.
+ * @param value Pointer to the value.
+ * @see List
+ * @see Node
+ * @see node_create
+ * @see Express::chain
+ *
+ * Creates a new node using node_create then pushes the node to the end of the
+ * List.
+ */
+static inline void list_push(List *list, void *value) {
+  if (!list || !value)
+    return;
+
+  Node *node = node_create(value, NULL, list->tail);
+  if (!node)
+    return;
+  list_mem_alloc(list, 1, sizeof(Node));
+#ifdef EXPRESS_QUEUE_WAIT
+  node->enqueued = express_ticks();
+#endif
+
+  if (list->tail) {
+    list->tail->next = node;
+    list->tail = node;
+  } else {
+    list->head = node;
+    list->tail = node;
+  }
+  list->length++;
+}
+
+/**
+ * @brief Frees a Node that left a list.
+ *
+ * @param list Pointer to the List the node belonged to.
+ * @param node Pointer to the unlinked Node.
+ * @see NodeBlock
+ *
+ * A node of a NodeBlock only frees the block when it is the last one of it.
+ * Nodes leave a list in order, so only the first block has to be checked.
+ */
+static inline void list_release(List *list, Node *node) {
+  NodeBlock *block = list->blocks;
+  if (!block || (uintptr_t)node < (uintptr_t)block->nodes ||
+      (uintptr_t)node >= (uintptr_t)(block->nodes + block->count)) {
+    free(node);
+    list_mem_free(list, 1, 1, sizeof(Node));
+    return;
+  }
+
+  if (node == &block->nodes[block->count - 1]) {
+    list->blocks = block->next;
+    list_mem_free(list, 1, block->count,
+                  sizeof(NodeBlock) + block->count * sizeof(Node));
+    free(block);
+  }
+}
+
+/**
+ * @brief Unlinks and frees the first Node of a list.
+ *
+ * @param list Pointer to the List to pop from.
+ * @param enqueued Receives Node::enqueued, may be **NULL**.
+ * @return Pointer to the value holded by the popped Node.
+ * @see list_shift
+ */
+static inline void *list_take(List *list, uint64_t *enqueued) {
+  if (!list || !list->tail)
+    return NULL;
+
+  Node *node = list->head;
+  if (list->head == list->tail)
+    list->head = list->tail = NULL;
+  else {
+    node->next->prev = NULL;
+    list->head = node->next;
+  }
+  list->length--;
+
+  void *value = node->value;
+#ifdef EXPRESS_QUEUE_WAIT
+  if (enqueued)
+    *enqueued = node->enqueued;
+#else
+  (void)enqueued;
+#endif
+  list_release(list, node);
+  EXPRESS_PROBE(shift, list->length, value);
+  return value;
+}
+
+/**
+ * @brief Pops the first Node from the beginning of the chain.
+ *
+ * @param list Pointer to the List to pop from.
+ * @return Pointer to the value holded by the popped Node.
+ * @see Node
+ *
+ * The value is never allocated or freed by the list functions.
+ * Do it on your own.
+ *
+ * Simple example to free all values holded by the linked list.
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~{.c}
+ * Express app = express_create();
+ * ...
+ * void *value = NULL;
+ *
+ * while (value = list_shift(&app.chain)) {
+ *  free(value);
+ * }
+ * ~~~~~~~~~~~~~~~~~~~~~~
+ *
+ * The previous example could fail if a value was set as *NULL*.
+ * So, implement your types well.
+ */
+static inline void *list_shift(List *list) {
+  return list_take(list, NULL);
+}
+
+/* =============== Histogram ================== */
+
+/**
+ * @brief Returns the bucket index of a value.
+ *
+ * @param value Value to find the bucket of.
+ * @return Index in Histogram::buckets.
+ */
+static inline size_t histogram_index(uint64_t value) {
+  if (value < (2u << HISTOGRAM_SUB_BITS))
+    return (size_t)value;
+  if (value >> HISTOGRAM_MAX_BITS)
+    return HISTOGRAM_BUCKETS - 1;
+
+  unsigned shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+  size_t sub = (size_t)(value >> shift) - (1u << HISTOGRAM_SUB_BITS);
+  return ((size_t)(shift + 1) << HISTOGRAM_SUB_BITS) + sub;
+}
+
+/**
+ * @brief Returns the largest value that lands in a bucket.
+ *
+ * @param index Index in Histogram::buckets.
+ * @return Upper bound of the bucket.
+ */
+static inline uint64_t histogram_value(size_t index) {
+  if (index < (2u << HISTOGRAM_SUB_BITS))
+    return index;
+
+  unsigned shift = (unsigned)(index >> HISTOGRAM_SUB_BITS) - 1;
+  uint64_t sub = (index & ((1u << HISTOGRAM_SUB_BITS) - 1)) +
+                 (1u << HISTOGRAM_SUB_BITS);
+  return ((sub + 1) << shift) - 1;
+}
+
+/**
+ * @brief Records a value.
+ *
+ * @param histogram Pointer to Histogram.
+ * @param value Value to record.
+ * @see Histogram
+ */
+static inline void histogram_record(Histogram *histogram, uint64_t value) {
+  histogram->buckets[histogram_index(value)]++;
+  histogram->count++;
+  if (value > histogram->max)
+    histogram->max = value;
+}
+
+/* =============== Shared Memory Stats ================== */
+
+#ifdef EXPRESS_SHM_STATS
+/**
+ * @brief Adds to a shared counter.
+ *
+ * @param counter Pointer to the counter.
+ * @param n Value to add.
+ *
+ * The caller must hold Express::lock, so a relaxed load and store are enough.
+ */
+static inline void express_shm_add(_Atomic uint64_t *counter, uint64_t n) {
+  uint64_t value = atomic_load_explicit(counter, memory_order_relaxed);
+  atomic_store_explicit(counter, value + n, memory_order_relaxed);
+}
+
+/**
+ * @brief Publishes the chain depth.
+ *
+ * @param shm Pointer to ExpressShmStats, may be **NULL**.
+ * @param depth Current length of the chain.
+ *
+ * The caller must hold Express::lock.
+ */
+static inline void express_shm_depth(ExpressShmStats *shm, size_t depth) {
+  atomic_store_explicit(&shm->depth, depth, memory_order_relaxed);
+  if (depth > atomic_load_explicit(&shm->max_depth, memory_order_relaxed))
+    atomic_store_explicit(&shm->max_depth, depth, memory_order_relaxed);
+}
+#endif /* EXPRESS_SHM_STATS */
+
+/* =============== Lock ================== */
+
+#ifdef EXPRESS_LOCK_STATS
+/**
+ * @brief Records that the lock was just taken.
+ *
+ * @param profile Pointer to ExpressLockProfile of the locked Express.
+ * @param site Call site that took the lock.
+ * @param wait Ticks spent waiting, zero if the lock was free.
+ */
+static inline void express_lock_acquired(ExpressLockProfile *profile,
+                                         ExpressLockSite site, uint64_t wait) {
+  ExpressLockCounters *counters = &profile->sites[site];
+
+  counters->acquisitions++;
+  if (wait) {
+    counters->contended++;
+    counters->wait += wait;
+    if (wait > counters->max_wait)
+      counters->max_wait = wait;
+  }
+
+  profile->site = site;
+  profile->held_since = express_ticks();
+}
+#endif /* EXPRESS_LOCK_STATS */
+
+/**
+ * @brief Locks Express::lock.
+ *
+ * @param app Pointer to Express object.
+ * @param site Call site taking the lock, only used by EXPRESS_LOCK_STATS.
+ *
+ * Does nothing when built with EXPRESS_SINGLE_THREADED.
+ *
+ * With EXPRESS_LOCK_STATS or EXPRESS_SHM_STATS the lock is tried first, the
+ * wait is only timed and counted when the lock was busy.
+ */
+static inline void express_lock(Express *app, ExpressLockSite site) {
+  (void)site;
+#if defined(EXPRESS_LOCK_STATS) ||                                             \
+    (defined(EXPRESS_SHM_STATS) && !defined(EXPRESS_SINGLE_THREADED))
+  uint64_t wait = 0;
+  if (pthread_mutex_trylock(&app->lock) != 0) {
+    uint64_t start = express_ticks();
+    pthread_mutex_lock(&app->lock);
+    wait = express_ticks() - start;
+    if (!wait)
+      wait = 1;
+  }
+#ifdef EXPRESS_LOCK_STATS
+  express_lock_acquired(app->lock_profile, site, wait);
+#endif
+#ifdef EXPRESS_SHM_STATS
+  if (wait && app->shm)
+    express_shm_add(&app->shm->lock_waits, 1);
+#endif
+#elif !defined(EXPRESS_SINGLE_THREADED)
+  pthread_mutex_lock(&app->lock);
+#else
+  (void)app;
+#endif
+}
+
+#ifndef EXPRESS_SINGLE_THREADED
+/**
+ * @brief Tries to lock Express::lock without waiting.
+ *
+ * @param app Pointer to Express object.
+ * @param site Call site taking the lock, only used by EXPRESS_LOCK_STATS.
+ * @return Zero if the lock was taken.
+ */
+static inline int express_trylock(Express *app, ExpressLockSite site) {
+  if (pthread_mutex_trylock(&app->lock) != 0)
+    return 1;
+#ifdef EXPRESS_LOCK_STATS
+  express_lock_acquired(app->lock_profile, site, 0);
+#else
+  (void)site;
+#endif
+  return 0;
+}
+#endif /* EXPRESS_SINGLE_THREADED */
+
+/**
+ * @brief Unlocks Express::lock.
+ *
+ * @param app Pointer to Express object.
+ *
+ * Does nothing when built with EXPRESS_SINGLE_THREADED.
+ */
+static inline void express_unlock(Express *app) {
+#ifdef EXPRESS_LOCK_STATS
+  ExpressLockProfile *profile = app->lock_profile;
+  histogram_record(&profile->sites[profile->site].hold,
+                   express_ticks() - profile->held_since);
+#endif
+#ifndef EXPRESS_SINGLE_THREADED
+  pthread_mutex_unlock(&app->lock);
+#else
+  (void)app;
+#endif
+}
+
+/* =============== Express ================== */
+
+#ifdef EXPRESS_TAGGED
+/**
+ * @brief Finds a callback in EXPRESS_CALLBACKS.
+ *
+ * @param cb Pointer to ExpressCallback function.
+ * @return ID of **cb**, E_CALLBACK_NONE if it is not registered.
+ */
+static inline unsigned express_callback_id(ExpressCallback cb) {
+#define EXPRESS_CALLBACK_MATCH(name)                                           \
+  if (cb == name)                                                              \
+    return E_CALLBACK_##name;
+  EXPRESS_CALLBACKS(EXPRESS_CALLBACK_MATCH)
+#undef EXPRESS_CALLBACK_MATCH
+  (void)cb;
+  return E_CALLBACK_NONE;
+}
+#endif
+
+/**
+ * @brief Queues a callback at the end of a chain.
+ *
+ * @param list Chain or batch to push to.
+ * @param cb Pointer to ExpressCallback function.
+ *
+ * With the switch and goto engines the Node is tagged with the ID of **cb**,
+ * so the lookup is paid once per add rather than once per call. Does
+ * nothing if **cb** is **NULL**, like list_push.
+ */
+static inline void express_push(List *list, ExpressCallback cb) {
+  if (!cb)
+    return;
+  list_push(list, cb);
+#ifdef EXPRESS_TAGGED
+  list->tail->id = express_callback_id(cb);
+#endif
+}
+
+/**
+ * @brief Queues one callback at the end of the Express chain.
+ *
+ * @param app Pointer to Express object.
+ * @param cb Pointer to ExpressCallback function, not **NULL**.
+ *
+ * The critical section of express_add, also run by the combiner of
+ * ExpressCombining for every request it applies, so both count the add in
+ * the shared stats, fire `express:add`, trace and record it. A combined
+ * add is reported by the thread that applied it. The caller must hold
+ * Express::lock.
+ */
+static inline void express_enqueue(Express *app, ExpressCallback cb) {
+  express_push(&app->chain, cb);
+  EXPRESS_PROBE(add, app->chain.length, cb);
+#ifdef EXPRESS_SHM_STATS
+  if (app->shm) {
+    express_shm_add(&app->shm->enqueued, 1);
+    express_shm_depth(app->shm, app->chain.length);
+  }
+#endif
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_ADD, cb, 0, express_ticks());
+#endif
+#ifdef EXPRESS_RECORD
+  express_record_add(app, cb);
+#endif
+}
+
+/**
+ * @brief Adds a callback to the Express chain.
+ *
+ * @param app Pointer to Express object.
+ * @param cb Pointer to ExpressCallback function.
+ *
+ * This function will do nothing if **app** or **cb** is **NULL**.
+ *
+ * This function is *Thread Safe*.
+ */
+static inline void express_add(Express *app, ExpressCallback cb) {
+  if (!app || !cb)
+    return;
+  express_lock(app, E_LOCK_ADD);
+  express_enqueue(app, cb);
+  express_unlock(app);
+}
+
+/**
+ * @brief Moves a batch of nodes to the end of the Express chain.
+ *
+ * @param app Pointer to Express object.
+ * @param batch Private List of the new nodes, left empty.
+ * @param n Number of callbacks asked for, for the trace.
+ *
+ * The only critical section of express_add_many and
+ * express_build_from_array.
+ */
+static inline void express_splice(Express *app, List *batch, size_t n) {
+  express_lock(app, E_LOCK_ADD_MANY);
+#ifdef EXPRESS_SHM_STATS
+  if (app->shm) {
+    express_shm_add(&app->shm->enqueued, batch->length);
+    express_shm_depth(app->shm, app->chain.length + batch->length);
+  }
+#endif
+  list_splice(&app->chain, batch);
+  express_unlock(app);
+#ifdef EXPRESS_TRACE
+  express_trace(E_TRACE_ADD_MANY, NULL, (uint32_t)n, express_ticks());
+#else
+  (void)n;
+#endif
+}
+
+/**
+ * @brief Adds an array of callbacks to the Express chain.
+ *
+ * @param app Pointer to Express object.
+ * @param cbs Array of ExpressCallback functions.
+ * @param n Number of callbacks in **cbs**.
+ *
+ * The nodes are created outside the lock into a private List, which is then
+ * spliced to the end of the chain in a single critical section.
+ *
+ * **NULL** entries in **cbs** are skipped.
+ *
+ * This function is *Thread Safe*.
+ */
+static inline void express_add_many(Express *app, const ExpressCallback *cbs,
+                                    size_t n) {
+  if (!app || !cbs || !n)
+    return;
+
+  List batch = {0};
+  for (size_t i = 0; i < n; i++)
+    express_push(&batch, cbs[i]);
+
+  express_splice(app, &batch, n);
+#ifdef EXPRESS_RECORD
+  express_record_many(app, cbs, n);
+#endif
+}
+
+/**
+ * @brief Adds an array of callbacks to the Express chain, with a single
+ * allocation for all of their nodes.
+ *
+ * @param app Pointer to Express object.
+ * @param cbs Array of ExpressCallback functions, added in array order.
+ * @param n Number of callbacks in **cbs**.
+ * @see NodeBlock
+ *
+ * Meant for building large chains at startup: the nodes are laid out in one
+ * NodeBlock outside the lock, then spliced to the end of the chain like
+ * express_add_many. The block is only freed once all of its nodes were
+ * executed or the chain is cleared.
+ *
+ * **NULL** entries in **cbs** are skipped.
+ *
+ * This function is *Thread Safe*.
+ */
+static inline void express_build_from_array(Express *app,
+                                            const ExpressCallback *cbs,
+                                            size_t n) {
+  if (!app || !cbs || !n)
+    return;
+
+  size_t count = 0;
+  for (size_t i = 0; i < n; i++)
+    count += cbs[i] != NULL;
+  if (!count)
+    return;
+
+  NodeBlock *block = node_block_create(count);
+  Node *node = block->nodes;
+#ifdef EXPRESS_QUEUE_WAIT
+  uint64_t now = express_ticks();
+#endif
+  for (size_t i = 0; i < n; i++) {
+    if (!cbs[i])
+      continue;
+    node->value = cbs[i];
+    node->next = node + 1;
+    node->prev = node > block->nodes ? node - 1 : NULL;
+#ifdef EXPRESS_QUEUE_WAIT
+    node->enqueued = now;
+#endif
+#ifdef EXPRESS_TAGGED
+    node->id = express_callback_id(cbs[i]);
+#endif
+    node++;
+  }
+
+  List batch = {.head = block->nodes,
+                .tail = &block->nodes[count - 1],
+                .length = count,
+                .blocks = block};
+  batch.tail->next = NULL;
+  list_mem_alloc(&batch, count, sizeof(NodeBlock) + count * sizeof(Node));
+
+  express_splice(app, &batch, n);
+#ifdef EXPRESS_RECORD
+  express_record_many(app, cbs, n);
+#endif
+}
+
+/**
+ * @brief Publishes the thread about to run the chain.
+ *
+ * @param app Pointer to the locked Express object.
+ * @return Call number of the last callback the chain ran.
+ */
+static inline uint64_t express_watch_begin(Express *app) {
+#ifdef EXPRESS_WATCHDOG
+  static _Thread_local pid_t tid = 0;
+  if (!tid)
+    tid = gettid();
+  atomic_store_explicit(&app->watch->tid, tid, memory_order_relaxed);
+  return app->watch->calls;
+#else
+  (void)app;
+  return 0;
+#endif
+}
+
+/**
+ * @brief Publishes the callback about to run, the one store the watchdog
+ * costs per callback.
+ *
+ * @param app Pointer to the locked Express object.
+ * @param cb Pointer to ExpressCallback function.
+ * @param calls Call number of **cb**.
+ */
+static inline void express_watch(Express *app, ExpressCallback cb,
+                                 uint64_t calls) {
+#ifdef EXPRESS_WATCHDOG
+  atomic_store_explicit(&app->watch->current,
+                        calls << 48 | ((uintptr_t)cb & ((1ull << 48) - 1)),
+                        memory_order_relaxed);
+#else
+  (void)app;
+  (void)cb;
+  (void)calls;
+#endif
+}
+
+/**
+ * @brief Publishes that the chain is idle.
+ *
+ * @param app Pointer to the locked Express object.
+ * @param calls Call number of the last callback run.
+ */
+static inline void express_watch_end(Express *app, uint64_t calls) {
+#ifdef EXPRESS_WATCHDOG
+  atomic_store_explicit(&app->watch->current, 0, memory_order_relaxed);
+  app->watch->calls = calls;
+#else
+  (void)app;
+  (void)calls;
+#endif
+}
+
+/**
+ * @brief Runs one callback of the chain without instrumentation.
+ *
+ * @param app Pointer to the locked Express object.
+ * @param cb Pointer to ExpressCallback function.
+ * @return The ExpressCommand returned by **cb**.
+ *
+ * Only the static probes, which cost a `nop` each, surround the call.
+ */
+static inline ExpressCommand express_call(Express *app, ExpressCallback cb) {
+  (void)app;
+  EXPRESS_PROBE(callback__start, app->chain.length, cb);
+  ExpressCommand cmd = cb();
+  EXPRESS_PROBE(callback__done, cmd, cb);
+  return cmd;
+}
+
+/**
+ * @brief Dequeues the next callback of the chain.
+ *
+ * @param app Pointer to the locked Express object.
+ * @return Pointer to ExpressCallback function, **NULL** if the chain is empty.
+ *
+ * With EXPRESS_QUEUE_WAIT, records how long the callback waited.
+ */
+static inline ExpressCallback express_shift(Express *app) {
+#ifdef EXPRESS_QUEUE_WAIT
+  uint64_t enqueued;
+  ExpressCallback cb = list_take(&app->chain, &enqueued);
+  if (cb)
+    histogram_record(&app->queue_wait->wait, express_ticks() - enqueued);
+  return cb;
+#else
+  return list_shift(&app->chain);
+#endif
+}
+
+#if EXPRESS_DISPATCH == EXPRESS_DISPATCH_ARRAY
+/**
+ * @brief Runs the callbacks of the chain that are stored in its first
+ * NodeBlock.
+ *
+ * @param app Pointer to the locked Express object, its head is a node of
+ * the first block of List::blocks.
+ * @param calls Call number of the last callback run, updated.
+ * @return The ExpressCommand returned by the last callback run.
+ *
+ * From the head to the end of the block, the nodes are an array in chain
+ * order, so they are called by index. The head, tail and length of the
+ * chain follow every call, for the probes and the queue wait, but the
+ * nodes are not unlinked one by one and the block is freed once, after
+ * its last callback.
+ */
+static inline ExpressCommand express_drain_block(Express *app,
+                                                 uint64_t *calls) {
+  List *list = &app->chain;
+  NodeBlock *block = list->blocks;
+  Node *node = list->head, *end = block->nodes + block->count;
+  ExpressCommand cmd = E_CONTINUE;
+
+  while (cmd == E_CONTINUE && node < end) {
+    ExpressCallback cb = node->value;
+    list->head = node->next;
+    if (!list->head)
+      list->tail = NULL;
+    list->length--;
+#ifdef EXPRESS_QUEUE_WAIT
+    histogram_record(&app->queue_wait->wait, express_ticks() - node->enqueued);
+#endif
+    EXPRESS_PROBE(shift, list->length, cb);
+    express_watch(app, cb, ++*calls);
+    cmd = express_call(app, cb);
+    node++;
+  }
+
+  if (list->head)
+    list->head->prev = NULL;
+  if (node == end) {
+    list->blocks = block->next;
+    list_mem_free(list, 1, block->count,
+                  sizeof(NodeBlock) + block->count * sizeof(Node));
+    free(block);
+  }
+  return cmd;
+}
+#endif
+
+/**
+ * @brief Runs the chain until it is empty or a callback triggers.
+ *
+ * @param app Pointer to the locked Express object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if the chain
+ * was drained.
+ *
+ * Calls the callbacks with the engine chosen by EXPRESS_DISPATCH.
+ */
+static inline ExpressCommand express_drain(Express *app) {
+  ExpressCallback cb = NULL;
+  ExpressCommand cmd = E_CONTINUE;
+  uint64_t calls = express_watch_begin(app);
+
+#if EXPRESS_DISPATCH == EXPRESS_DISPATCH_ARRAY
+  while (cmd == E_CONTINUE && app->chain.head) {
+    NodeBlock *block = app->chain.blocks;
+    Node *head = app->chain.head;
+    if (block && head >= block->nodes && head < block->nodes + block->count) {
+      cmd = express_drain_block(app, &calls);
+    } else {
+      cb = express_shift(app);
+      express_watch(app, cb, ++calls);
+      cmd = express_call(app, cb);
+    }
+  }
+#elif EXPRESS_DISPATCH == EXPRESS_DISPATCH_SWITCH
+  while (cmd == E_CONTINUE && app->chain.head) {
+    unsigned id = app->chain.head->id;
+    cb = express_shift(app);
+    express_watch(app, cb, ++calls);
+    EXPRESS_PROBE(callback__start, app->chain.length, cb);
+    switch (id) {
+#define EXPRESS_CALLBACK_CASE(name)                                            \
+  case E_CALLBACK_##name:                                                      \
+    cmd = name();                                                              \
+    break;
+      EXPRESS_CALLBACKS(EXPRESS_CALLBACK_CASE)
+#undef EXPRESS_CALLBACK_CASE
+    default:
+      cmd = cb();
+      break;
+    }
+    EXPRESS_PROBE(callback__done, cmd, cb);
+  }
+#elif EXPRESS_DISPATCH == EXPRESS_DISPATCH_GOTO
+#define EXPRESS_CALLBACK_LABEL(name) &&call_##name,
+#define EXPRESS_CALLBACK_THREAD(name)                                          \
+  call_##name : cb = express_shift(app);                                       \
+  express_watch(app, cb, ++calls);                                             \
+  EXPRESS_PROBE(callback__start, app->chain.length, cb);                       \
+  cmd = name();                                                                \
+  EXPRESS_PROBE(callback__done, cmd, cb);                                      \
+  if (cmd != E_CONTINUE || !app->chain.head)                                   \
+    goto done;                                                                 \
+  goto *targets[app->chain.head->id];
+
+  static void *const targets[] = {
+      &&call_indirect, EXPRESS_CALLBACKS(EXPRESS_CALLBACK_LABEL)};
+
+  if (!app->chain.head)
+    goto done;
+  goto *targets[app->chain.head->id];
+
+call_indirect:
+  cb = express_shift(app);
+  express_watch(app, cb, ++calls);
+  cmd = express_call(app, cb);
+  if (cmd != E_CONTINUE || !app->chain.head)
+    goto done;
+  goto *targets[app->chain.head->id];
+
+  EXPRESS_CALLBACKS(EXPRESS_CALLBACK_THREAD)
+#undef EXPRESS_CALLBACK_THREAD
+#undef EXPRESS_CALLBACK_LABEL
+
+done:
+#else
+  while (cmd == E_CONTINUE && (cb = express_shift(app))) {
+    express_watch(app, cb, ++calls);
+    cmd = express_call(app, cb);
+  }
+#endif
+  express_watch_end(app, calls);
+  return cmd;
+}
+
+#ifdef EXPRESS_INSTRUMENTED
+/**
+ * @brief Tells if this execution is instrumented.
+ *
+ * @param app Pointer to the locked Express object.
+ * @return Non zero for 1 in Express::sample_every calls.
+ */
+static inline int express_sample(Express *app) {
+  if (!app->sample_every || --app->sample_countdown)
+    return 0;
+  app->sample_countdown = app->sample_every;
+  return 1;
+}
+#endif /* EXPRESS_INSTRUMENTED */
+
+/**
+ * @brief Executes the Express chain.
+ *
+ * @param app Pointer to Express object.
+ * @return E_TRIGGER if a callback stopped the chain, E_CONTINUE if the chain
+ * was drained.
+ *
+ * This function is *Thread Safe*.
+ */
+static inline ExpressCommand express_execute(Express *app) {
+  if (!app)
+    return E_CONTINUE;
+
+#ifdef EXPRESS_RECORD
+  uint64_t start = express_now_ns();
+#endif
+  express_lock(app, E_LOCK_EXECUTE);
+
+#if defined(EXPRESS_SHM_STATS) || defined(EXPRESS_RECORD)
+  size_t depth = app->chain.length;
+#endif
+
+#ifdef EXPRESS_INSTRUMENTED
+  ExpressCommand cmd =
+      express_sample(app) ? express_drain_sampled(app) : express_drain(app);
+#else
+  ExpressCommand cmd = express_drain(app);
+#endif
+
+#ifdef EXPRESS_SHM_STATS
+  if (app->shm) {
+    express_shm_add(&app->shm->executed, depth - app->chain.length);
+    express_shm_add(&app->shm->triggered, cmd == E_TRIGGER);
+    express_shm_depth(app->shm, app->chain.length);
+  }
+#endif
+#ifdef EXPRESS_RECORD
+  size_t ran = depth - app->chain.length;
+#endif
+
+  express_unlock(app);
+#ifdef EXPRESS_RECORD
+  express_record_execute(app, start, ran, cmd);
+#endif
+  return cmd;
+}
+
+#ifndef EXPRESS_SINGLE_THREADED
+/**
+ * @def express_add
+ * @brief Adds a callback to an Express object or to any of its variants.
+ *
+ * Calls express_sharded_add, express_percpu_add or express_combining_add
+ * when **app** points to that variant, the inline express_add otherwise. So
+ * code written against `express_add` and `express_execute` moves to a
+ * variant by only changing how the object is declared, created and
+ * destroyed. The variant keeps its own ordering rules, see ExpressSharded.
+ *
+ * Only calls go through the macro, `express_add` without arguments is still
+ * the function and can be taken as a pointer.
+ *
+ * @def express_execute
+ * @brief Executes an Express object or any of its variants, see
+ * express_add.
+ */
+#define express_add(app, cb)                                                   \
+  _Generic((app),                                                              \
+      ExpressSharded *: express_sharded_add,                                   \
+      ExpressPerCpu *: express_percpu_add,                                     \
+      ExpressCombining *: express_combining_add,                               \
+      default: express_add)(app, cb)
+#define express_execute(app)                                                   \
+  _Generic((app),                                                              \
+      ExpressSharded *: express_sharded_execute,                               \
+      ExpressPerCpu *: express_percpu_execute,                                 \
+      ExpressCombining *: express_combining_execute,                           \
+      default: express_execute)(app)
+#endif
+
+#endif /* EXPRESS_H */
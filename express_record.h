@@ -0,0 +1,96 @@
+/**
+ * @file express_record.h
+ * @brief Layout of the workload recordings of Express objects.
+ *
+ * Written by express.c when built with EXPRESS_RECORD, read by
+ * `bench/replay`. A recording is an ExpressRecordHeader, followed by
+ * ExpressRecordHeader::events ExpressRecordEvent and then by
+ * ExpressRecordHeader::callbacks ExpressRecordCallback. Values are in the
+ * byte order of the recording host.
+ *
+ * Events of one thread are in the order they happened, the events of
+ * different threads are interleaved in chunks.
+ */
+
+#ifndef EXPRESS_RECORD_H
+#define EXPRESS_RECORD_H
+
+#include <stdint.h>
+
+/**
+ * @def EXPRESS_RECORD_MAGIC
+ * @brief First word of every recording, "EXPR" in little endian.
+ */
+#define EXPRESS_RECORD_MAGIC 0x52505845u
+
+/**
+ * @def EXPRESS_RECORD_VERSION
+ * @brief Bumped whenever the layout of a recording changes.
+ */
+#define EXPRESS_RECORD_VERSION 1u
+
+/**
+ * @def EXPRESS_RECORD_NAME
+ * @brief Size of ExpressRecordCallback::name, including the final zero.
+ */
+#define EXPRESS_RECORD_NAME 48
+
+/**
+ * @typedef ExpressRecordType
+ * @brief Kinds of recorded events.
+ * @see ExpressRecordEvent
+ */
+typedef enum ExpressRecordType {
+  E_RECORD_ADD,      /**< express_add of callback ExpressRecordEvent::arg */
+  E_RECORD_ADD_MANY, /**< Batch of ExpressRecordEvent::arg callbacks */
+  E_RECORD_CALLBACK, /**< Callback ExpressRecordEvent::arg of the batch */
+  E_RECORD_EXECUTE,  /**< express_execute that ran arg callbacks */
+} ExpressRecordType;
+
+/**
+ * @typedef ExpressRecordHeader
+ * @brief Start of a recording.
+ *
+ * ExpressRecordHeader::events and ExpressRecordHeader::callbacks are only
+ * filled in when the recording stops, they are zero in the file of a
+ * process that did not stop it.
+ */
+typedef struct ExpressRecordHeader {
+  uint32_t magic;       /**< EXPRESS_RECORD_MAGIC.*/
+  uint32_t version;     /**< EXPRESS_RECORD_VERSION.*/
+  uint32_t event_size;  /**< sizeof(ExpressRecordEvent).*/
+  uint32_t callbacks;   /**< Number of ExpressRecordCallback.*/
+  uint64_t events;      /**< Number of ExpressRecordEvent.*/
+  uint64_t duration_ns; /**< Time between the start and the stop.*/
+} ExpressRecordHeader;
+
+/**
+ * @typedef ExpressRecordEvent
+ * @brief One add or execute of a recorded Express object.
+ *
+ * An E_RECORD_ADD_MANY event, made by express_add_many or
+ * express_build_from_array, is followed by one E_RECORD_CALLBACK event of
+ * the same thread for each callback of the batch. For E_RECORD_EXECUTE,
+ * ExpressRecordEvent::ns is when the call started and
+ * ExpressRecordEvent::value how long it took.
+ */
+typedef struct ExpressRecordEvent {
+  uint64_t ns;    /**< Nanoseconds since the recording started.*/
+  uint32_t tid;   /**< Thread that made the call.*/
+  uint16_t app;   /**< Express object, numbered in creation order.*/
+  uint8_t type;   /**< ExpressRecordType.*/
+  uint8_t cmd;    /**< ExpressCommand returned by an execute.*/
+  uint32_t arg;   /**< Callback number, batch size or callbacks run.*/
+  uint32_t value; /**< Nanoseconds an execute took.*/
+} ExpressRecordEvent;
+
+/**
+ * @typedef ExpressRecordCallback
+ * @brief A callback of the recording, numbered in order of first use.
+ */
+typedef struct ExpressRecordCallback {
+  uint64_t address;               /**< Address in the recorded process.*/
+  char name[EXPRESS_RECORD_NAME]; /**< Symbol name, empty if unknown.*/
+} ExpressRecordCallback;
+
+#endif /* EXPRESS_RECORD_H */
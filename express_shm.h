@@ -0,0 +1,60 @@
+/**
+ * @file express_shm.h
+ * @brief Layout of the shared memory statistics segment of an Express object.
+ *
+ * Written by express.c when built with EXPRESS_SHM_STATS, read by the
+ * `express-top` tool.
+ */
+
+#ifndef EXPRESS_SHM_H
+#define EXPRESS_SHM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/**
+ * @def EXPRESS_SHM_PREFIX
+ * @brief Prefix of the segment names, followed by `<pid>-<id>`.
+ *
+ * On Linux the segments show up in `/dev/shm` without the leading slash.
+ */
+#define EXPRESS_SHM_PREFIX "/express-"
+
+/**
+ * @def EXPRESS_SHM_MAGIC
+ * @brief First word of every segment, "EXPS" in little endian.
+ */
+#define EXPRESS_SHM_MAGIC 0x53505845u
+
+/**
+ * @def EXPRESS_SHM_VERSION
+ * @brief Bumped whenever ExpressShmStats changes.
+ */
+#define EXPRESS_SHM_VERSION 1u
+
+/**
+ * @typedef ExpressShmStats
+ * @brief Live counters of one Express object.
+ * @see ExpressShmStats
+ *
+ * @struct ExpressShmStats
+ * @brief Live counters of one Express object, mapped in shared memory.
+ *
+ * Counters are only written while Express::lock is held, with relaxed atomic
+ * stores, so readers never see a torn value and writers never pay for a read
+ * modify write.
+ */
+typedef struct ExpressShmStats {
+  uint32_t magic;               /**< EXPRESS_SHM_MAGIC.*/
+  uint32_t version;             /**< EXPRESS_SHM_VERSION.*/
+  int32_t pid;                  /**< Process that owns the Express object.*/
+  uint32_t id;                  /**< Express object number in the process.*/
+  _Atomic uint64_t enqueued;    /**< Callbacks added to the chain.*/
+  _Atomic uint64_t executed;    /**< Callbacks that ran.*/
+  _Atomic uint64_t triggered;   /**< Runs stopped by E_TRIGGER.*/
+  _Atomic uint64_t depth;       /**< Callbacks currently in the chain.*/
+  _Atomic uint64_t max_depth;   /**< Largest depth seen.*/
+  _Atomic uint64_t lock_waits;  /**< Express::lock acquisitions that waited.*/
+} ExpressShmStats;
+
+#endif /* EXPRESS_SHM_H */
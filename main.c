@@ -0,0 +1,97 @@
+/**
+ * @file main.c
+ * @brief Demo program of the Express chain.
+ */
+
+#include "express.h"
+
+/**
+ * @brief ExpressCallback function that prints hello.
+ * @see express_add
+ *
+ * @return E_CONTINUE as an ExpressCommand to continue chain exection.
+ */
+ExpressCommand hello_callback(void);
+
+/**
+ * @brief ExpressCallback that prints out.
+ * @see express_add
+ *
+ * @return E_CONTINUE as an ExpressCommand to continue chain exection.
+ */
+ExpressCommand out_callback(void);
+
+/**
+ * @brief ExpressCallback that prints trigger.
+ * @see express_add
+ *
+ * @return E_TRIGGER as an ExpressCommand to stop chain exection.
+ */
+ExpressCommand trigger_callback(void);
+
+/* =============== Main ================== */
+
+int main(void) {
+  Express app = express_create();
+#ifdef EXPRESS_WATCHDOG
+  express_watchdog_start(0);
+#endif
+#ifdef EXPRESS_RECORD
+  express_record_start("express.record");
+#endif
+
+  express_add(&app, hello_callback);
+  express_add(&app, trigger_callback);
+  express_add(&app, out_callback);
+
+  express_execute(&app);
+#ifdef EXPRESS_HISTOGRAMS
+  express_latency_report(&app, stdout);
+#endif
+#ifdef EXPRESS_PERF_COUNTERS
+  express_perf_report(&app, stdout);
+#endif
+#ifdef EXPRESS_MEM_STATS
+  express_mem_report(&app, stdout);
+#endif
+#ifdef EXPRESS_QUEUE_WAIT
+  ExpressLatency wait = express_queue_wait(&app);
+  printf("queue wait: count %llu, p50 %llu ns, p99 %llu ns, max %llu ns\n",
+         (unsigned long long)wait.count, (unsigned long long)wait.p50,
+         (unsigned long long)wait.p99, (unsigned long long)wait.max);
+#endif
+#ifdef EXPRESS_LOCK_STATS
+  express_lock_report(&app, stdout);
+#endif
+#ifdef EXPRESS_TRACE
+  FILE *trace = fopen("express.trace.json", "w");
+  if (trace) {
+    express_trace_dump(trace);
+    fclose(trace);
+  }
+#endif
+#ifdef EXPRESS_WATCHDOG
+  express_watchdog_stop();
+#endif
+#ifdef EXPRESS_RECORD
+  express_record_stop();
+#endif
+  express_destroy(&app);
+
+  return 0;
+}
+
+ExpressCommand hello_callback() {
+  printf("Hello\n");
+  return E_CONTINUE;
+}
+
+ExpressCommand out_callback() {
+  printf("Out\n");
+  return E_CONTINUE;
+}
+
+ExpressCommand trigger_callback() {
+  printf("Trigger\n");
+  return E_TRIGGER;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file express-top.c
+ * @brief Live view of the Express objects of every running process.
+ *
+ * Usage: `express-top [-n count] [-d seconds]`
+ *
+ * Reads the shared memory segments published by programs built with
+ * EXPRESS_SHM_STATS and prints one line per Express object every interval,
+ * with the enqueue and execute rates since the previous refresh.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../express_shm.h"
+
+/**
+ * @def TOP_MAX_SEGMENTS
+ * @brief Largest number of segments shown at once.
+ */
+#define TOP_MAX_SEGMENTS 256
+
+/**
+ * @typedef TopSample
+ * @brief Counters of one segment at the previous refresh.
+ */
+typedef struct TopSample {
+  int32_t pid;       /**< Owner process.*/
+  uint32_t id;       /**< Express object number.*/
+  uint64_t enqueued; /**< ExpressShmStats::enqueued.*/
+  uint64_t executed; /**< ExpressShmStats::executed.*/
+} TopSample;
+
+static TopSample previous[TOP_MAX_SEGMENTS];
+static size_t previous_count = 0;
+
+/**
+ * @brief Finds the previous sample of a segment.
+ *
+ * @return Pointer to the sample, **NULL** for a new segment.
+ */
+static const TopSample *top_previous(int32_t pid, uint32_t id) {
+  for (size_t i = 0; i < previous_count; i++)
+    if (previous[i].pid == pid && previous[i].id == id)
+      return &previous[i];
+  return NULL;
+}
+
+/**
+ * @brief Maps a segment read only.
+ *
+ * @param name Segment name as found in `/dev/shm`.
+ * @return Pointer to the segment, **NULL** if it is not a valid one.
+ */
+static const ExpressShmStats *top_map(const char *name) {
+  char path[NAME_MAX + 2];
+  snprintf(path, sizeof(path), "/%s", name);
+
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  const ExpressShmStats *shm =
+      mmap(NULL, sizeof(ExpressShmStats), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm == MAP_FAILED)
+    return NULL;
+
+  if (shm->magic != EXPRESS_SHM_MAGIC || shm->version != EXPRESS_SHM_VERSION) {
+    munmap((void *)shm, sizeof(ExpressShmStats));
+    return NULL;
+  }
+  return shm;
+}
+
+/**
+ * @brief Prints one refresh.
+ *
+ * @param interval Seconds since the previous refresh.
+ */
+static void top_refresh(double interval) {
+  TopSample current[TOP_MAX_SEGMENTS];
+  size_t count = 0;
+
+  DIR *dir = opendir("/dev/shm");
+  if (!dir) {
+    perror("/dev/shm");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("%8s %4s %12s %12s %10s %10s %10s %10s %10s %10s %6s\n", "pid", "id",
+         "enqueued", "executed", "add/s", "exec/s", "triggered", "depth",
+         "max depth", "lock waits", "state");
+
+  const char *prefix = EXPRESS_SHM_PREFIX + 1;
+  struct dirent *entry;
+  while ((entry = readdir(dir)) && count < TOP_MAX_SEGMENTS) {
+    if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0)
+      continue;
+
+    const ExpressShmStats *shm = top_map(entry->d_name);
+    if (!shm)
+      continue;
+
+    TopSample *sample = &current[count++];
+    sample->pid = shm->pid;
+    sample->id = shm->id;
+    sample->enqueued = atomic_load_explicit(&shm->enqueued,
+                                            memory_order_relaxed);
+    sample->executed = atomic_load_explicit(&shm->executed,
+                                            memory_order_relaxed);
+
+    const TopSample *last = top_previous(sample->pid, sample->id);
+    double add_rate = 0, exec_rate = 0;
+    if (last && interval > 0) {
+      add_rate = (double)(sample->enqueued - last->enqueued) / interval;
+      exec_rate = (double)(sample->executed - last->executed) / interval;
+    }
+
+    int alive = kill(shm->pid, 0) == 0 || errno == EPERM;
+    printf("%8d %4u %12llu %12llu %10.0f %10.0f %10llu %10llu %10llu %10llu "
+           "%6s\n",
+           (int)sample->pid, sample->id, (unsigned long long)sample->enqueued,
+           (unsigned long long)sample->executed, add_rate, exec_rate,
+           (unsigned long long)atomic_load_explicit(&shm->triggered,
+                                                    memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&shm->depth,
+                                                    memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&shm->max_depth,
+                                                    memory_order_relaxed),
+           (unsigned long long)atomic_load_explicit(&shm->lock_waits,
+                                                    memory_order_relaxed),
+           alive ? "live" : "stale");
+
+    munmap((void *)shm, sizeof(ExpressShmStats));
+  }
+  closedir(dir);
+
+  memcpy(previous, current, count * sizeof(TopSample));
+  previous_count = count;
+}
+
+int main(int argc, char **argv) {
+  long iterations = -1;
+  double delay = 1.0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:d:")) != -1) {
+    switch (opt) {
+    case 'n':
+      iterations = strtol(optarg, NULL, 10);
+      break;
+    case 'd':
+      delay = strtod(optarg, NULL);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n count] [-d seconds]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  for (long i = 0; iterations < 0 || i < iterations; i++) {
+    if (i) {
+      usleep((useconds_t)(delay * 1e6));
+      if (isatty(STDOUT_FILENO))
+        printf("\033[H\033[2J");
+    }
+    top_refresh(i ? delay : 0);
+    fflush(stdout);
+  }
+
+  return 0;
+}